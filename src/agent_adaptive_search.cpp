@@ -22,7 +22,7 @@ BitBoard rank_1(0x00000000000000FF);
 
 bool do_randomization = false;
 
-int32_t score_end_states(const Position& position, MoveList& legal_moves)
+int32_t score_end_states(const Position& position, const std::vector<Move>& legal_moves)
 {
   auto& board = position.GetBoard();
   bool is_draw = false;
@@ -51,7 +51,8 @@ class TreeNode
 {
 public:
   int64_t budget_used = 0;
-  MoveList legal_moves;
+  // Kept on the heap, tree nodes outlive the move generator's inline list.
+  std::vector<Move> legal_moves;
   std::vector<TreeNode> children;
   int32_t best_score = ABS_MIN_SCORE;
   int32_t own_score = ABS_MIN_SCORE;
@@ -78,7 +79,8 @@ void budgeted_search(PositionHistory& position_history, int64_t allowed_budget,
   auto& board = position.GetBoard();
   if (node.budget_used == 0)
   {
-    node.legal_moves = board.GenerateLegalMoves();
+    auto legal_moves = board.GenerateLegalMoves();
+    node.legal_moves.assign(legal_moves.begin(), legal_moves.end());
     node.children.reserve(node.legal_moves.size());
     for (uint32_t i = 0; i < node.legal_moves.size(); i++)
     {
@@ -109,8 +111,8 @@ void budgeted_search(PositionHistory& position_history, int64_t allowed_budget,
     node.own_score += ((board.knights()&board.ours()).count() - (board.knights()&board.theirs()).count())*300;
     node.own_score += ((board.pawns()&board.ours()).count() - (board.pawns()&board.theirs()).count())*100;
 
-    // Calculate legal moves
-    //node.own_score += (int32_t)(node.legal_moves.size() - position.GetThemBoard().GenerateLegalMoves().size())*10;
+    // Mobility, counted without generating the opponent's moves
+    node.own_score += (int32_t)(node.legal_moves.size() - position.GetThemBoard().CountLegalMoves())*10;
 
     node.own_score += score_position_with_piece_squares(position);
 
@@ -138,6 +140,16 @@ void budgeted_search(PositionHistory& position_history, int64_t allowed_budget,
     return;
   }
 
+  // Captures losing material by static exchange evaluation. Their light scan
+  // counts the captured piece before seeing the recapture, so they only get
+  // the minimum budget share, like the weakest other moves.
+  bool is_losing_capture[num_moves];
+  for (uint32_t i = 0; i < num_moves; ++i)
+  {
+    auto move = node.legal_moves[i];
+    is_losing_capture[i] = board.theirs().get(move.to()) && !board.SEEGreaterOrEqual(move, 0);
+  }
+
   // Allocate search budget
   float mean_score = 0;
   int32_t min_score = ABS_MAX_SCORE;
@@ -171,6 +183,10 @@ void budgeted_search(PositionHistory& position_history, int64_t allowed_budget,
   for (uint32_t i = 0; i < num_moves; ++i)
   {
     move_scores[i] = std::max((-node.children[i].best_score) - min_score, 0) + 100;
+    if (is_losing_capture[i])
+    {
+      move_scores[i] = 100;
+    }
     total_score += move_scores[i];
   }
 
@@ -243,7 +259,7 @@ void budgeted_search(PositionHistory& position_history, int64_t allowed_budget,
 }
 
 
-void getBestLine(TreeNode& node, MoveList& best_line)
+void getBestLine(TreeNode& node, std::vector<Move>& best_line)
 {
   if (node.legal_moves.empty())
   {
@@ -263,7 +279,7 @@ class CustomUCILoop : public UciLoop {
 
   void dump_info(TreeNode& node, PositionHistory& position_history)
   {
-    MoveList best_line;
+    std::vector<Move> best_line;
     getBestLine(node, best_line);
     bool black_to_move = position_history.IsBlackToMove();
     ThinkingInfo info;
@@ -302,7 +318,7 @@ class CustomUCILoop : public UciLoop {
     std::cout << "Time: " << elapsed_seconds << std::endl;
     std::cout << "Budget: "<< budget_used << std::endl;
     std::cout << "Best line:";
-    MoveList best_line;
+    std::vector<Move> best_line;
     getBestLine(node, best_line);
     bool black_to_move = position_history.IsBlackToMove();
     for (auto& move : best_line)
@@ -376,6 +392,7 @@ class CustomUCILoop : public UciLoop {
 
   void CmdUci() override {
     SendId();
+    SendResponse("info string " + BackendsDebugString());
     SendResponse("uciok");
   }
   void CmdIsReady() override {SendResponse("readyok");}
@@ -411,6 +428,15 @@ class CustomUCILoop : public UciLoop {
         {
           real_move.Mirror();
         }
+        // Castling as the king capturing its rook, like in the tree.
+        const auto& board = new_position_history.Last().GetBoard();
+        real_move = board.GetModernMove(real_move);
+        if (!board.IsLegal(real_move))
+        {
+          SendResponse("info string Ignoring illegal move " + moves[move_idx] + " and the ones after it");
+          reset_tree = true;
+          break;
+        }
         new_position_history.Append(real_move);
 
         if (!reset_tree)
@@ -475,7 +501,6 @@ class CustomUCILoop : public UciLoop {
 };
 
 int main() {
-  InitializeMagicBitboards();
   /*
   ChessBoard board(ChessBoard::kStartposFen);
   std::cout << board.DebugString();
@@ -1,7 +1,19 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
 #include "board.h"
 #include "uciloop.h"
 #include "christian_utils.h"
+#include "move_picker.h"
+#include "transposition_table.h"
 
 using namespace lczero;
 
@@ -14,15 +26,10 @@ BitBoard rank_3(0x0000000000FF0000);
 BitBoard rank_2(0x000000000000FF00);
 BitBoard rank_1(0x00000000000000FF);
 
-int basicChessScore(ChessBoard board, int turn_num)
+// Scores "our" material, advancement and development against "theirs".
+int basicChessScore(const ChessBoard& board)
 {
   int score = 0;
-  if (board.GenerateLegalMoves().empty()) {
-    if (board.IsUnderCheck()) {
-      // Checkmate.
-      return -50000 + turn_num*10;
-    }
-  }
 
   // Basic material scoring
   score += ((board.queens()&board.ours()).count() - (board.queens()&board.theirs()).count())*900;
@@ -49,55 +56,262 @@ int basicChessScore(ChessBoard board, int turn_num)
   return score;
 }
 
-int findBestMove_inner(ChessBoard board, int turn_num, int depth, Move* move_out, int alpha, int beta)
+// Being mated @ply plies from the root scores -(kMate - ply), so that nearer
+// mates score higher. Scores past kMateThreshold are mates. The table stores
+// them counted from the node instead, the same wherever the position
+// transposes to.
+constexpr int kMate = 50000;
+constexpr int kMateThreshold = kMate - 1000;
+
+int scoreToTT(int score, int ply)
 {
-  auto legal_moves = board.GenerateLegalMoves();
-  if (legal_moves.empty()) {
-    if (board.IsUnderCheck()) {
-      // Checkmate.
-      return -50000 + turn_num*10;
-    }
+  if (score > kMateThreshold) return score + ply;
+  if (score < -kMateThreshold) return score - ply;
+  return score;
+}
+
+int scoreFromTT(int score, int ply)
+{
+  if (score > kMateThreshold) return score - ply;
+  if (score < -kMateThreshold) return score + ply;
+  return score;
+}
+
+// Counters of a search, reported after it.
+struct SearchStats {
+  // The main thread sums the node counts of all threads while they search.
+  std::atomic<uint64_t> nodes{0};
+  // Nodes of the quiescence search, not counted in nodes.
+  std::atomic<uint64_t> qnodes{0};
+  uint64_t tt_probes = 0;
+  uint64_t tt_hits = 0;
+  uint64_t tt_cutoffs = 0;
+  // Beta cutoffs in the main search, and those by the first move searched.
+  uint64_t cutoffs = 0;
+  uint64_t first_move_cutoffs = 0;
+
+  void Reset()
+  {
+    nodes = 0;
+    qnodes = 0;
+    tt_probes = tt_hits = tt_cutoffs = cutoffs = first_move_cutoffs = 0;
+  }
+};
+
+// Counts a node. Only the searching thread writes the counter, so a load and
+// a store do, without the cost of a locked increment.
+void countNode(std::atomic<uint64_t>& counter)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// A thread of the search. With Lazy SMP every thread searches the same
+// position with iterative deepening, each with its own copy of the board and
+// its own move ordering, and they only share the transposition table; the
+// helpers fill it with results which the main thread then finds. Only the
+// main thread's move is played.
+struct SearchThread {
+  // 0 for the main thread.
+  int index = 0;
+  MoveOrdering ordering;
+  SearchStats stats;
+  // Turn of the root of the running search, to count plies from it.
+  int root_turn_num = 0;
+};
+
+TranspositionTable tt;
+std::vector<std::unique_ptr<SearchThread>> search_threads;
+
+// Nodes searched by all threads so far.
+uint64_t totalNodes()
+{
+  uint64_t nodes = 0;
+  for (const auto& thread : search_threads)
+  {
+    nodes += thread->stats.nodes.load(std::memory_order_relaxed) +
+             thread->stats.qnodes.load(std::memory_order_relaxed);
+  }
+  return nodes;
+}
+
+// When the running search has to stop early. Only deeper iterations are cut
+// off, the first one always completes so that there is a move to play.
+struct SearchLimits {
+  std::chrono::steady_clock::time_point hard_deadline =
+      std::chrono::steady_clock::time_point::max();
+  uint64_t max_nodes = std::numeric_limits<uint64_t>::max();
+  bool can_abort = false;
+};
+
+SearchLimits limits;
+// Set once the limits are hit, or the main thread is done; every node of
+// every thread then returns at once, and the result of the iteration is
+// thrown away.
+std::atomic<bool> search_aborted{false};
+
+// The limits are checked once per this many nodes of the main thread.
+constexpr uint64_t kClockCheckInterval = 1024;
+
+// Only the main thread checks the limits, the helpers stop with it.
+bool shouldAbort(const SearchThread& thread)
+{
+  if (thread.index != 0 || !limits.can_abort) return false;
+  const uint64_t nodes = thread.stats.nodes.load(std::memory_order_relaxed) +
+                         thread.stats.qnodes.load(std::memory_order_relaxed);
+  if (nodes % kClockCheckInterval != 0) return false;
+  return totalNodes() >= limits.max_nodes ||
+         std::chrono::steady_clock::now() >= limits.hard_deadline;
+}
+
+// Value of the piece captured by @move, plus what a queen promotion adds, as
+// SEE() values them. @move is one of GenerateCaptures().
+int captureGain(const ChessBoard& board, Move move)
+{
+  int gain = 0;
+  const BoardSquare to = move.to();
+  if (board.queens().get(to)) gain = 900;
+  else if (board.rooks().get(to)) gain = 500;
+  else if (board.bishops().get(to) || board.knights().get(to)) gain = 300;
+  // A pawn, or en passant.
+  else if (board.theirs().get(to) || move.from().col() != to.col()) gain = 100;
+  if (move.promotion() == Move::Promotion::Queen) gain += 800;
+  return gain;
+}
+
+// Captures which can't lift the score this close to alpha are skipped.
+constexpr int kDeltaMargin = 200;
+
+// Searches captures and queen promotions until the position is quiet, so that
+// leaves aren't scored in the middle of an exchange. The side to move may stand
+// pat on the static score instead of capturing, except in check where all
+// evasions are searched. Captures losing material by SEE, or winning too little
+// to reach alpha, are skipped.
+int quiesce(SearchThread& thread, const ChessBoard& board, int turn_num, int alpha, int beta)
+{
+  countNode(thread.stats.qnodes);
+  if (search_aborted || shouldAbort(thread))
+  {
+    search_aborted = true;
+    return 0;
   }
 
-  if (depth == 0)
+  const bool in_check = board.IsUnderCheck();
+  const int ply = turn_num - thread.root_turn_num;
+  int bestScore = -kMate + ply;
+  int stand_pat = 0;
+  if (!in_check)
   {
-    Move bestMove = legal_moves[0];
-    int bestScore = -100000000;
+    stand_pat = basicChessScore(board);
+    if (stand_pat >= beta)
+    {
+      return stand_pat;
+    }
+    bestScore = stand_pat;
+    alpha = std::max(alpha, stand_pat);
+  }
 
-    for (auto move : legal_moves)
+  // All evasions in check, otherwise the captures not losing material by SEE.
+  MovePicker picker = in_check ? MovePicker(board, Move(), thread.ordering, ply)
+                               : MovePicker(board);
+  for (Move move = picker.Next(); move; move = picker.Next())
+  {
+    if (!in_check && stand_pat + captureGain(board, move) + kDeltaMargin <= alpha)
     {
-      auto new_board = board;
-      new_board.ApplyMove(move);
-      int score = basicChessScore(new_board, turn_num);
-      if (score > bestScore)
-      {
-        bestMove = move;
-        bestScore = score;
-      }
+      continue;
     }
-    if (move_out)
+    auto new_board = board;
+    new_board.ApplyMove(move);
+    new_board.Mirror();
+    const int score = -quiesce(thread, new_board, turn_num+1, -beta, -alpha);
+    if (search_aborted)
     {
-      *move_out = bestMove;
+      return 0;
     }
-    return bestScore;
+    bestScore = std::max(bestScore, score);
+    if (score >= beta)
+    {
+      break;
+    }
+    alpha = std::max(alpha, score);
   }
+  return bestScore;
+}
+
+// Searches @depth plies, then the captures from there on. The root is never
+// searched at depth 0, it wouldn't get a move.
+int findBestMove_inner(SearchThread& thread, ChessBoard board, int turn_num, int depth, Move* move_out, int alpha, int beta)
+{
+  if (depth <= 0)
+  {
+    return quiesce(thread, board, turn_num, alpha, beta);
+  }
+  countNode(thread.stats.nodes);
+  if (search_aborted || shouldAbort(thread))
+  {
+    search_aborted = true;
+    return 0;
+  }
+  const int original_alpha = alpha;
+  const int ply = turn_num - thread.root_turn_num;
+
+  // A deep enough result with a bound that decides the window ends the node,
+  // except at the root which needs a move. Otherwise its move is tried first.
+  TTEntry entry;
+  Move tt_move;
+  thread.stats.tt_probes++;
+  if (tt.Probe(board.Hash(), &entry))
+  {
+    thread.stats.tt_hits++;
+    tt_move = entry.move;
+    const int score = scoreFromTT(entry.score, ply);
+    if (!move_out && entry.depth >= depth &&
+        (entry.bound == Bound::kExact ||
+         (entry.bound == Bound::kLower && score >= beta) ||
+         (entry.bound == Bound::kUpper && score <= alpha)))
+    {
+      thread.stats.tt_cutoffs++;
+      return score;
+    }
+  }
+
+  MovePicker picker(board, tt_move, thread.ordering, ply);
+  MoveList quiets_tried;
+  int moves_searched = 0;
 
   Move bestMove;
   int bestScore = -100000000;
 
-  for (auto move : legal_moves)
+  for (Move move = picker.Next(); move; move = picker.Next())
   {
     auto new_board = board;
     new_board.ApplyMove(move);
     new_board.Mirror();
     int score;
-    score = -findBestMove_inner(new_board, turn_num+1, depth-1, nullptr, -beta, -alpha);
+    score = -findBestMove_inner(thread, new_board, turn_num+1, depth-1, nullptr, -beta, -alpha);
+    if (search_aborted)
+    {
+      return 0;
+    }
+    moves_searched++;
 
-    if (score > beta)
+    if (score > bestScore)
     {
-      // Dead end
       bestMove = move;
       bestScore = score;
+    }
+
+    if (score >= beta)
+    {
+      // Dead end
+      thread.stats.cutoffs++;
+      if (moves_searched == 1)
+      {
+        thread.stats.first_move_cutoffs++;
+      }
+      if (picker.last_is_quiet())
+      {
+        thread.ordering.UpdateQuietCutoff(ply, depth, move, quiets_tried);
+      }
       break;
     }
 
@@ -105,36 +319,235 @@ int findBestMove_inner(ChessBoard board, int turn_num, int depth, Move* move_out
     {
       alpha = score;
     }
-
-    if (score >= bestScore)
+    if (picker.last_is_quiet())
     {
-      bestMove = move;
-      bestScore = score;
+      quiets_tried.push_back(move);
     }
   }
 
+  if (moves_searched == 0)
+  {
+    // Checkmate, or stalemate.
+    return board.IsUnderCheck() ? -kMate + ply : 0;
+  }
+
   if (move_out)
   {
     *move_out = bestMove;
   }
+  Bound bound = Bound::kExact;
+  if (bestScore >= beta)
+  {
+    bound = Bound::kLower;
+  }
+  else if (bestScore <= original_alpha)
+  {
+    bound = Bound::kUpper;
+  }
+  tt.Store(board.Hash(), bestMove, scoreToTT(bestScore, ply), depth, bound);
   return bestScore;
 
 }
 
-Move findBestMove(ChessBoard board, int turn_num, int depth)
+Move findBestMove(SearchThread& thread, ChessBoard board, int turn_num, int depth, int* score_out = nullptr)
 {
   Move out;
-  findBestMove_inner(board, turn_num, depth, &out, -1000000000, 1000000000);
+  thread.root_turn_num = turn_num;
+  int score = findBestMove_inner(thread, board, turn_num, depth, &out, -1000000000, 1000000000);
+  if (score_out)
+  {
+    *score_out = score;
+  }
   return out;
 }
 
+// Follows the best moves stored in the transposition table from @move on, for
+// up to @max_length moves. The moves are from white's point of view.
+std::vector<Move> getPV(ChessBoard board, Move move, int max_length)
+{
+  std::vector<Move> pv;
+  for (;;)
+  {
+    Move white_move = move;
+    if (board.flipped())
+    {
+      white_move.Mirror();
+    }
+    pv.push_back(white_move);
+    if (static_cast<int>(pv.size()) >= max_length)
+    {
+      break;
+    }
+    board.ApplyMove(move);
+    board.Mirror();
+    TTEntry entry;
+    if (!tt.Probe(board.Hash(), &entry) || !entry.move)
+    {
+      break;
+    }
+    const auto legal_moves = board.GenerateLegalMoves();
+    if (std::find(legal_moves.begin(), legal_moves.end(), entry.move) == legal_moves.end())
+    {
+      break;
+    }
+    move = entry.move;
+  }
+  return pv;
+}
+
+// Time to spend on the move, in milliseconds. No iteration starts after the
+// soft limit, and the search is cut off at the hard one. Without either the
+// search runs to its depth.
+struct TimeLimits {
+  std::optional<int64_t> soft;
+  std::optional<int64_t> hard;
+};
+
+// Kept back from the clock for the GUI and the operating system.
+constexpr int64_t kMoveOverheadMs = 30;
+// Moves the remaining time is spread over without movestogo.
+constexpr int kDefaultMovesToGo = 30;
+
+TimeLimits getTimeLimits(const GoParams& params, bool black)
+{
+  TimeLimits time_limits;
+  if (params.movetime)
+  {
+    // All of it, an iteration which would end later is cut off.
+    const int64_t time = std::max<int64_t>(*params.movetime - kMoveOverheadMs, 1);
+    time_limits.soft = time;
+    time_limits.hard = time;
+    return time_limits;
+  }
+  const auto& time = black ? params.btime : params.wtime;
+  if (!time)
+  {
+    return time_limits;
+  }
+  const int64_t increment = (black ? params.binc : params.winc).value_or(0);
+  const int moves_to_go = std::max(params.movestogo.value_or(kDefaultMovesToGo), 1);
+  const int64_t left = std::max<int64_t>(*time - kMoveOverheadMs, 1);
+  const int64_t target = std::min(left / moves_to_go + increment * 3 / 4, left);
+  // The next iteration usually takes longer than all the ones before, so
+  // there is no point starting one past half of the target.
+  time_limits.soft = std::max<int64_t>(target / 2, 1);
+  time_limits.hard = std::min(target * 3, left);
+  return time_limits;
+}
+
+// Sets the number of search threads, the main one included.
+void setSearchThreads(size_t count)
+{
+  search_threads.resize(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    if (!search_threads[i])
+    {
+      search_threads[i] = std::make_unique<SearchThread>();
+      search_threads[i]->index = static_cast<int>(i);
+    }
+  }
+}
+
+// Helpers skip some depths so that they don't all search the same one: helper
+// i skips the depths where (depth + kSkipPhase[i]) / kSkipSize[i] is odd, e.g.
+// the first searches the even depths and the second the odd ones. They spread
+// over more depths the more there are.
+constexpr int kSkipSize[] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+constexpr int kSkipPhase[] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+constexpr int kNumSkipPatterns = sizeof(kSkipSize) / sizeof(kSkipSize[0]);
+
+// Searches the position deeper and deeper until the main thread is done.
+void helperSearch(SearchThread& thread, ChessBoard board, int turn_num, int max_depth)
+{
+  const int pattern = (thread.index - 1) % kNumSkipPatterns;
+  for (int depth = 1; depth <= max_depth && !search_aborted; depth++)
+  {
+    if ((depth + kSkipPhase[pattern]) / kSkipSize[pattern] % 2 != 0)
+    {
+      continue;
+    }
+    findBestMove(thread, board, turn_num, depth);
+  }
+}
 
 class CustomUCILoop : public UciLoop {
   ChessBoard current_board;
   int turn_num = 0;
+  // Drops the output while benchmarking.
+  bool quiet = false;
+
+ public:
+  CustomUCILoop() { setSearchThreads(1); }
+
+  void SendResponses(const std::vector<std::string>& responses) override {
+    if (!quiet)
+    {
+      UciLoop::SendResponses(responses);
+    }
+  }
+
+  // Prints the time to reach @depth and the speed of the search with each
+  // number of threads in @thread_counts, summed over a set of positions each
+  // searched from an empty transposition table.
+  void RunBench(int depth, const std::vector<int>& thread_counts) {
+    std::printf("%s, depth %d\n", BackendsDebugString().c_str(), depth);
+    std::printf("%8s %12s %12s %12s %10s %10s\n", "threads", "time ms", "nodes",
+                "nps", "speedup", "nps ratio");
+    double base_time = 0;
+    double base_nps = 0;
+    for (const int threads : thread_counts)
+    {
+      setSearchThreads(threads);
+      int64_t time = 0;
+      uint64_t nodes = 0;
+      for (const char* fen : kBenchFens)
+      {
+        CmdUciNewGame();
+        CmdPosition(fen, {});
+        GoParams params;
+        params.depth = depth;
+        quiet = true;
+        const auto start = std::chrono::steady_clock::now();
+        CmdGo(params);
+        time += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        quiet = false;
+        nodes += totalNodes();
+      }
+      const double nps = nodes * 1e6 / std::max<int64_t>(time, 1);
+      if (base_time == 0)
+      {
+        base_time = time;
+        base_nps = nps;
+      }
+      std::printf("%8d %12.1f %12llu %12.0f %10.2f %10.2f\n", threads,
+                  time / 1000.0, static_cast<unsigned long long>(nodes), nps,
+                  base_time / time, nps / base_nps);
+    }
+  }
+
+ private:
+  static constexpr const char* kBenchFens[] = {
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+      "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+      "r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4",
+      "8/8/3k4/3p4/8/3P4/3K4/8 w - - 0 1",
+  };
+  static constexpr int kMaxThreads = 256;
 
   void CmdUci() override {
     SendId();
+    SendResponse("option name Hash type spin default " +
+                 std::to_string(TranspositionTable::kDefaultSizeMb) +
+                 " min 1 max " + std::to_string(TranspositionTable::kMaxSizeMb));
+    SendResponse("option name Threads type spin default 1 min 1 max " +
+                 std::to_string(kMaxThreads));
+    SendResponse("info string " + BackendsDebugString());
     SendResponse("uciok");
   }
   void SendId() override {
@@ -142,40 +555,126 @@ class CustomUCILoop : public UciLoop {
     SendResponse("id author computer-whisperer");
   }
   void CmdIsReady() override {SendResponse("readyok");}
-  void CmdUciNewGame() override {}
-  void CmdSetOption(const std::string& /*name*/,
-                    const std::string& /*value*/,
+  void CmdUciNewGame() override {
+    tt.Clear();
+    for (auto& thread : search_threads)
+    {
+      thread->ordering.Clear();
+    }
+  }
+  void CmdSetOption(const std::string& name,
+                    const std::string& value,
                     const std::string& /*context*/) override {
+    if (name == "Hash" || name == "hash")
+    {
+      tt.Resize(std::max(parseOption(name, value), 1));
+    }
+    else if (name == "Threads" || name == "threads")
+    {
+      setSearchThreads(std::clamp(parseOption(name, value), 1, kMaxThreads));
+    }
     SendResponse("setoption ok");
   }
+  static int parseOption(const std::string& name, const std::string& value) {
+    try
+    {
+      return std::stoi(value);
+    }
+    catch (const std::exception&)
+    {
+      throw Exception("invalid " + name + " value " + value);
+    }
+  }
   void CmdPosition(const std::string& position,
                    const std::vector<std::string>& moves) override {
+    int n_moves = 0;
     if (position.empty())
     {
       current_board = ChessBoard::kStartposBoard;
-      for (const auto& move : moves)
-      {
-        Move real_move(move);
-        if (current_board.flipped())
-        {
-          real_move.Mirror();
-        }
-        current_board.ApplyMove(real_move);
-        current_board.Mirror();
-        turn_num++;
-      }
     }
     else
     {
-      int n_moves;
       current_board.SetFromFen(position, nullptr, &n_moves);
-      turn_num = n_moves;
     }
+    for (const auto& move : moves)
+    {
+      Move real_move(move);
+      if (current_board.flipped())
+      {
+        real_move.Mirror();
+      }
+      current_board.ApplyMove(real_move);
+      current_board.Mirror();
+    }
+    turn_num = n_moves + moves.size();
 
   }
 
-  void CmdGo(const GoParams& /*params*/) override {
-    auto move = findBestMove(current_board, turn_num, 4);
+  // Searches one ply deeper each iteration until the depth or the time runs out,
+  // with the helper threads searching alongside until then. Searches without a
+  // clock or depth keep to a fixed depth; the loop doesn't read commands while
+  // searching, so "go infinite" can't be stopped and does the same.
+  void CmdGo(const GoParams& params) override {
+    const auto start = std::chrono::steady_clock::now();
+    const TimeLimits time_limits = getTimeLimits(params, current_board.flipped());
+    int max_depth = kMaxSearchDepth;
+    if (params.depth)
+    {
+      max_depth = std::clamp(*params.depth, 1, kMaxSearchDepth);
+    }
+    else if (!time_limits.hard && !params.nodes)
+    {
+      max_depth = kDefaultSearchDepth;
+    }
+
+    tt.NewSearch();
+    for (auto& thread : search_threads)
+    {
+      thread->ordering.NewSearch();
+      thread->stats.Reset();
+    }
+    limits = SearchLimits();
+    search_aborted = false;
+    if (time_limits.hard)
+    {
+      limits.hard_deadline = start + std::chrono::milliseconds(*time_limits.hard);
+    }
+    if (params.nodes)
+    {
+      limits.max_nodes = *params.nodes;
+    }
+
+    std::vector<std::thread> helpers;
+    for (size_t i = 1; i < search_threads.size(); i++)
+    {
+      helpers.emplace_back(helperSearch, std::ref(*search_threads[i]),
+                           current_board, turn_num, max_depth);
+    }
+
+    SearchThread& main_thread = *search_threads[0];
+    Move move;
+    for (int depth = 1; depth <= max_depth; depth++)
+    {
+      int score;
+      const Move iteration_move = findBestMove(main_thread, current_board, turn_num, depth, &score);
+      if (search_aborted)
+      {
+        break;
+      }
+      move = iteration_move;
+      limits.can_abort = true;
+      SendInfo({searchInfo(depth, score, getPV(current_board, move, depth),
+                           start)});
+      if (time_limits.soft && elapsedMs(start) >= *time_limits.soft)
+      {
+        break;
+      }
+    }
+    search_aborted = true;
+    for (auto& helper : helpers)
+    {
+      helper.join();
+    }
     //auto move = findBestMove(current_board, turn_num, 1, nullptr, -1000000000, 1000000000);
     if (current_board.flipped())
     {
@@ -185,10 +684,50 @@ class CustomUCILoop : public UciLoop {
     SendBestMove(move);
   }
 
+  static constexpr int kDefaultSearchDepth = 5;
+  static constexpr int kMaxSearchDepth = 63;
+
+  static int64_t elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+  }
+
+  // Depth, score, nodes and speed of all threads of the search started at
+  // @start so far, with the share of quiescence nodes. Then, for the main
+  // thread, how often the first move searched caused the cutoff, and the rates
+  // at which the transposition table found the position and ended the node.
+  static ThinkingInfo searchInfo(int depth, int score, std::vector<Move> pv,
+                                 std::chrono::steady_clock::time_point start) {
+    const SearchStats& stats = search_threads[0]->stats;
+    uint64_t qnodes = 0;
+    for (const auto& thread : search_threads)
+    {
+      qnodes += thread->stats.qnodes.load(std::memory_order_relaxed);
+    }
+    ThinkingInfo info;
+    info.depth = depth;
+    info.score = score;
+    info.nodes = totalNodes();
+    info.time = elapsedMs(start);
+    info.nps = info.nodes * 1000 / std::max<int64_t>(info.time, 1);
+    info.hashfull = tt.Hashfull();
+    info.pv = std::move(pv);
+    const auto percent = [](uint64_t count, uint64_t total) {
+      return std::to_string(total ? count * 100 / total : 0) + "%";
+    };
+    info.comment = "qnodes " + std::to_string(qnodes) + " (" +
+                   percent(qnodes, info.nodes) + ") first move cutoffs " +
+                   percent(stats.first_move_cutoffs, stats.cutoffs) +
+                   " tt hits " + percent(stats.tt_hits, stats.tt_probes) +
+                   " cutoffs " + percent(stats.tt_cutoffs, stats.tt_probes);
+    return info;
+  }
+
 };
 
-int main() {
-  InitializeMagicBitboards();
+// With "bench [depth] [threads...]" as arguments, prints how the search
+// scales with threads instead of running the UCI loop.
+int main(int argc, char** argv) {
   /*
   ChessBoard board(ChessBoard::kStartposFen);
   std::cout << board.DebugString();
@@ -203,6 +742,21 @@ int main() {
   std::cout << board.DebugString();*/
 
   CustomUCILoop uci_loop;
+  if (argc > 1 && std::string(argv[1]) == "bench")
+  {
+    const int depth = argc > 2 ? std::atoi(argv[2]) : 7;
+    std::vector<int> thread_counts;
+    for (int i = 3; i < argc; i++)
+    {
+      thread_counts.push_back(std::max(std::atoi(argv[i]), 1));
+    }
+    if (thread_counts.empty())
+    {
+      thread_counts = {1, 2, 4, 8, 16};
+    }
+    uci_loop.RunBench(depth, thread_counts);
+    return 0;
+  }
   uci_loop.RunLoop();
   return 0;
 }
@@ -0,0 +1,270 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018-2019 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "batch_attacks.h"
+
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include "cpu.h"
+#include "exception.h"
+
+namespace lczero {
+
+namespace {
+constexpr uint64_t kNotFileA = ~0x0101010101010101ULL;
+constexpr uint64_t kNotFileAB = ~0x0303030303030303ULL;
+constexpr uint64_t kNotFileH = ~0x8080808080808080ULL;
+constexpr uint64_t kNotFileGH = ~0xC0C0C0C0C0C0C0C0ULL;
+constexpr uint64_t kAll = ~0ULL;
+
+// A board per 64-bit lane. With the vector extensions of GCC and Clang the
+// same code runs on plain integers and on the wide registers; it only has to
+// be inlined into a function built for the instruction set.
+typedef uint64_t Lanes4 __attribute__((vector_size(32)));
+typedef uint64_t Lanes8 __attribute__((vector_size(64)));
+
+// Shifts towards rank 8 and file h if positive, towards rank 1 and file a if
+// negative.
+template <int kShift, typename V>
+[[gnu::always_inline]] inline V Shift(V v) {
+  if constexpr (kShift > 0) {
+    return v << kShift;
+  } else {
+    return v >> -kShift;
+  }
+}
+
+// Kogge-Stone fill: the attacks of the sliders on @gen in the direction of
+// @kShift, up to and including the first square not in @empty. @kWrap drops
+// the squares a step wraps around the board edge to.
+template <int kShift, uint64_t kWrap, typename V>
+[[gnu::always_inline]] inline V SlidingAttacks(V gen, V empty) {
+  V pro = empty & kWrap;
+  gen |= pro & Shift<kShift>(gen);
+  pro &= Shift<kShift>(pro);
+  gen |= pro & Shift<2 * kShift>(gen);
+  pro &= Shift<2 * kShift>(pro);
+  gen |= pro & Shift<4 * kShift>(gen);
+  return Shift<kShift>(gen) & kWrap;
+}
+
+// Bit count of each lane, with operations every instruction set has on
+// 64-bit lanes.
+template <typename V>
+[[gnu::always_inline]] inline V Popcount(V x) {
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  x = x + (x >> 8);
+  x = x + (x >> 16);
+  x = x + (x >> 32);
+  return x & 0x7F;
+}
+
+template <typename V>
+[[gnu::always_inline]] inline V Load(const uint64_t* lanes) {
+  V v;
+  std::memcpy(&v, lanes, sizeof(V));
+  return v;
+}
+
+template <typename V>
+[[gnu::always_inline]] inline void Store(V v, uint64_t* lanes) {
+  std::memcpy(lanes, &v, sizeof(V));
+}
+
+// Computes the attacks of the boards from @first on in groups of kLanes, and
+// returns where it stopped. The boards left over are fewer than a group.
+template <typename V, size_t kLanes>
+[[gnu::always_inline]] inline size_t ComputeGroups(const ChessBoard* boards,
+                                                   size_t first, size_t size,
+                                                   BatchAttacks* attacks) {
+  // The pieces are gathered lane by lane, then loaded as vectors.
+  alignas(sizeof(V)) uint64_t pawns[kLanes];
+  alignas(sizeof(V)) uint64_t knights[kLanes];
+  alignas(sizeof(V)) uint64_t rooks[kLanes];
+  alignas(sizeof(V)) uint64_t bishops[kLanes];
+  alignas(sizeof(V)) uint64_t king[kLanes];
+  alignas(sizeof(V)) uint64_t empty[kLanes];
+
+  size_t i = first;
+  for (; i + kLanes <= size; i += kLanes) {
+    for (size_t lane = 0; lane < kLanes; lane++) {
+      const ChessBoard& board = boards[i + lane];
+      const BitBoard theirs = board.theirs();
+      pawns[lane] = (board.pawns() & theirs).as_int();
+      knights[lane] = (board.knights() & theirs).as_int();
+      rooks[lane] = ((board.rooks() | board.queens()) & theirs).as_int();
+      bishops[lane] = ((board.bishops() | board.queens()) & theirs).as_int();
+      king[lane] = (board.kings() & theirs).as_int();
+      empty[lane] = ~(board.ours() | theirs).as_int();
+    }
+
+    // Their pawns capture downwards.
+    const V p = Load<V>(pawns);
+    const V pawn_attacks = Shift<-9>(p & kNotFileA) | Shift<-7>(p & kNotFileH);
+
+    const V n = Load<V>(knights);
+    const V one = (Shift<1>(n) & kNotFileA) | (Shift<-1>(n) & kNotFileH);
+    const V two = (Shift<2>(n) & kNotFileAB) | (Shift<-2>(n) & kNotFileGH);
+    const V knight_attacks =
+        Shift<16>(one) | Shift<-16>(one) | Shift<8>(two) | Shift<-8>(two);
+
+    const V e = Load<V>(empty);
+    const V r = Load<V>(rooks);
+    const V b = Load<V>(bishops);
+    const V slider_attacks =
+        SlidingAttacks<8, kAll>(r, e) | SlidingAttacks<-8, kAll>(r, e) |
+        SlidingAttacks<1, kNotFileA>(r, e) |
+        SlidingAttacks<-1, kNotFileH>(r, e) |
+        SlidingAttacks<9, kNotFileA>(b, e) |
+        SlidingAttacks<7, kNotFileH>(b, e) |
+        SlidingAttacks<-7, kNotFileA>(b, e) |
+        SlidingAttacks<-9, kNotFileH>(b, e);
+
+    const V k = Load<V>(king);
+    const V sideways = (Shift<1>(k) & kNotFileA) | (Shift<-1>(k) & kNotFileH);
+    const V row = k | sideways;
+    const V king_attacks = sideways | Shift<8>(row) | Shift<-8>(row);
+
+    const V all = pawn_attacks | knight_attacks | slider_attacks | king_attacks;
+    Store(pawn_attacks, &attacks->pawns[i]);
+    Store(knight_attacks, &attacks->knights[i]);
+    Store(slider_attacks, &attacks->sliders[i]);
+    Store(king_attacks, &attacks->king[i]);
+    Store(all, &attacks->all[i]);
+    if constexpr (std::is_same_v<V, uint64_t>) {
+      attacks->count[i] = BitBoard(all).count();
+    } else {
+      const V count = Popcount(all);
+      for (size_t lane = 0; lane < kLanes; lane++) {
+        attacks->count[i + lane] = count[lane];
+      }
+    }
+  }
+  return i;
+}
+
+size_t ComputeScalar(const ChessBoard* boards, size_t first, size_t size,
+                     BatchAttacks* attacks) {
+  return ComputeGroups<uint64_t, 1>(boards, first, size, attacks);
+}
+
+#if defined(__x86_64__)
+[[gnu::target("avx2")]] size_t ComputeAvx2(const ChessBoard* boards,
+                                           size_t size,
+                                           BatchAttacks* attacks) {
+  return ComputeGroups<Lanes4, 4>(boards, 0, size, attacks);
+}
+
+[[gnu::target("avx512f")]] size_t ComputeAvx512(const ChessBoard* boards,
+                                               size_t size,
+                                               BatchAttacks* attacks) {
+  return ComputeGroups<Lanes8, 8>(boards, 0, size, attacks);
+}
+#endif
+
+BatchBackend BestBatchBackend() {
+  if (IsBatchBackendSupported(BatchBackend::kAvx512)) {
+    return BatchBackend::kAvx512;
+  }
+  if (IsBatchBackendSupported(BatchBackend::kAvx2)) return BatchBackend::kAvx2;
+  return BatchBackend::kScalar;
+}
+
+BatchBackend batch_backend = BestBatchBackend();
+}  // namespace
+
+bool IsBatchBackendSupported(BatchBackend backend) {
+  switch (backend) {
+    case BatchBackend::kAvx512:
+#if defined(__x86_64__)
+      return GetCpuFeatures().avx512;
+#else
+      return false;
+#endif
+    case BatchBackend::kAvx2:
+#if defined(__x86_64__)
+      return GetCpuFeatures().avx2;
+#else
+      return false;
+#endif
+    case BatchBackend::kScalar:
+      return true;
+  }
+  return false;
+}
+
+BatchBackend GetBatchBackend() { return batch_backend; }
+
+void SetBatchBackend(BatchBackend backend) {
+  if (!IsBatchBackendSupported(backend)) {
+    throw Exception(std::string("Batch backend not supported: ") +
+                    BatchBackendName(backend));
+  }
+  batch_backend = backend;
+}
+
+const char* BatchBackendName(BatchBackend backend) {
+  switch (backend) {
+    case BatchBackend::kAvx512:
+      return "avx512";
+    case BatchBackend::kAvx2:
+      return "avx2";
+    case BatchBackend::kScalar:
+      return "scalar";
+  }
+  return "unknown";
+}
+
+void BatchAttacks::Resize(size_t size) {
+  pawns.resize(size);
+  knights.resize(size);
+  sliders.resize(size);
+  king.resize(size);
+  all.resize(size);
+  count.resize(size);
+}
+
+void ComputeBatchAttacks(const ChessBoard* boards, size_t size,
+                         BatchAttacks* attacks) {
+  attacks->Resize(size);
+  size_t done = 0;
+#if defined(__x86_64__)
+  if (batch_backend == BatchBackend::kAvx512) {
+    done = ComputeAvx512(boards, size, attacks);
+  } else if (batch_backend == BatchBackend::kAvx2) {
+    done = ComputeAvx2(boards, size, attacks);
+  }
+#endif
+  // The boards left over from the last full group.
+  ComputeScalar(boards, done, size, attacks);
+}
+
+}  // namespace lczero
@@ -0,0 +1,79 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018-2019 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "board.h"
+
+namespace lczero {
+
+// How ComputeBatchAttacks() processes the boards. All backends compute
+// slider attacks with Kogge-Stone fills rather than table lookups, so that
+// every step is the same shift, and or and and on all boards at once. The best
+// backend for the CPU is picked at startup.
+enum class BatchBackend : uint8_t {
+  // One board at a time in 64-bit registers.
+  kScalar,
+  // Four boards per instruction in 256-bit registers.
+  kAvx2,
+  // Eight boards per instruction in 512-bit registers.
+  kAvx512,
+};
+
+// Returns whether this build and CPU can run @backend.
+bool IsBatchBackendSupported(BatchBackend backend);
+BatchBackend GetBatchBackend();
+// Switches the backend, e.g. to compare them. Throws if unsupported.
+void SetBatchBackend(BatchBackend backend);
+const char* BatchBackendName(BatchBackend backend);
+
+// Squares attacked by "their" (black) pieces on a batch of boards, with the
+// board occupancy as it is. Each array holds one entry per board, in the order
+// of the boards.
+struct BatchAttacks {
+  std::vector<uint64_t> pawns;
+  std::vector<uint64_t> knights;
+  // Bishops, rooks and queens.
+  std::vector<uint64_t> sliders;
+  std::vector<uint64_t> king;
+  std::vector<uint64_t> all;
+  // Number of squares in all.
+  std::vector<uint8_t> count;
+
+  void Resize(size_t size);
+};
+
+// Computes the attacks of "their" pieces on @size boards into @attacks,
+// resizing its arrays to fit.
+void ComputeBatchAttacks(const ChessBoard* boards, size_t size,
+                         BatchAttacks* attacks);
+
+}  // namespace lczero
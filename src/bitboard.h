@@ -27,12 +27,16 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <initializer_list>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "bititer.h"
+#include "cpu.h"
 
 namespace lczero {
 
@@ -61,10 +65,10 @@ class BoardSquare {
   void Mirror() { square_ = square_ ^ 0b111000; }
 
   // Checks whether coordinate is within 0..7.
-  static bool IsValidCoord(int x) { return x >= 0 && x < 8; }
+  static constexpr bool IsValidCoord(int x) { return x >= 0 && x < 8; }
 
   // Checks whether coordinates are within 0..7.
-  static bool IsValid(int row, int col) {
+  static constexpr bool IsValid(int row, int col) {
     return IsValidCoord(row) && IsValidCoord(col);
   }
 
@@ -95,7 +99,7 @@ class BitBoard {
   BitBoard(const BitBoard&) = default;
   BitBoard& operator=(const BitBoard&) = default;
 
-  std::uint64_t as_int() const { return board_; }
+  constexpr std::uint64_t as_int() const { return board_; }
   void clear() { board_ = 0; }
 
   // Counts the number of set bits in the BitBoard.
@@ -110,6 +114,16 @@ class BitBoard {
     return _mm_popcnt_u64(board_);
 #elif defined(_MSC_VER)
     return __popcnt(board_) + __popcnt(board_ >> 32);
+#elif defined(__x86_64__) && !defined(__POPCNT__)
+    // Not built for popcnt CPUs, where the builtin is a library call. The
+    // instruction goes through inline assembly to be usable on the CPUs which
+    // have it anyway.
+    if (kCpuHasPopcnt) {
+      std::uint64_t count;
+      asm("popcnt %1, %0" : "=r"(count) : "r"(board_));
+      return count;
+    }
+    return __builtin_popcountll(board_);
 #else
     return __builtin_popcountll(board_);
 #endif
@@ -296,6 +310,80 @@ class Move {
   };
 };
 
-using MoveList = std::vector<Move>;
+// Fixed-capacity list of moves, stored inline so that move generation does
+// not touch the heap. No legal chess position has more than 218 moves, so
+// 256 entries are enough for both pseudolegal and legal move lists.
+class MoveList {
+ public:
+  static constexpr size_t kMaxMoves = 256;
+
+  using value_type = Move;
+  using size_type = size_t;
+  using reference = Move&;
+  using const_reference = const Move&;
+  using iterator = Move*;
+  using const_iterator = const Move*;
+
+  MoveList() {}
+  MoveList(std::initializer_list<Move> moves) {
+    for (const auto& move : moves) push_back(move);
+  }
+  // Only the used part of the storage is copied.
+  MoveList(const MoveList& other) : size_(other.size_) {
+    std::copy(other.begin(), other.end(), begin());
+  }
+  MoveList& operator=(const MoveList& other) {
+    size_ = other.size_;
+    std::copy(other.begin(), other.end(), begin());
+    return *this;
+  }
+
+  void push_back(Move move) {
+    assert(size_ < kMaxMoves);
+    moves_[size_++] = move;
+  }
+  template <typename... Args>
+  Move& emplace_back(Args&&... args) {
+    assert(size_ < kMaxMoves);
+    return moves_[size_++] = Move(std::forward<Args>(args)...);
+  }
+  void pop_back() { --size_; }
+  void clear() { size_ = 0; }
+  // Kept for std::vector compatibility, storage is always preallocated.
+  void reserve([[maybe_unused]] size_t size) { assert(size <= kMaxMoves); }
+
+  // Removes moves in [first, last), shifting the tail down.
+  iterator erase(const_iterator first, const_iterator last) {
+    iterator pos = begin() + (first - begin());
+    iterator new_end = std::copy(last, cend(), pos);
+    size_ = new_end - begin();
+    return pos;
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  Move& operator[](size_t idx) { return moves_[idx]; }
+  const Move& operator[](size_t idx) const { return moves_[idx]; }
+  Move& front() { return moves_[0]; }
+  const Move& front() const { return moves_[0]; }
+  Move& back() { return moves_[size_ - 1]; }
+  const Move& back() const { return moves_[size_ - 1]; }
+
+  iterator begin() { return moves_; }
+  iterator end() { return moves_ + size_; }
+  const_iterator begin() const { return moves_; }
+  const_iterator end() const { return moves_ + size_; }
+  const_iterator cbegin() const { return moves_; }
+  const_iterator cend() const { return moves_ + size_; }
+
+ private:
+  size_t size_ = 0;
+  // Unions don't default-construct their members, which saves zeroing the
+  // whole array every time a list is created.
+  union {
+    Move moves_[kMaxMoves];
+  };
+};
 
 }  // namespace lczero
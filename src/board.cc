@@ -28,16 +28,23 @@
 #include "board.h"
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cctype>
 #include <cstdlib>
 #include <cstring>
 #include <sstream>
+#include <type_traits>
 
+#include "cpu.h"
 #include "exception.h"
 
-#if not defined(NO_PEXT)
-// Include header for pext instruction.
-#include <immintrin.h>
+// The pext backend issues the instructions with x86-64 inline assembly.
+#if !defined(__x86_64__) && !defined(NO_PEXT)
+#define NO_PEXT
+#endif
+#if defined(NO_PEXT) && defined(COMPRESSED_PEXT)
+#error "COMPRESSED_PEXT relies on pext/pdep and can't be used with NO_PEXT."
 #endif
 
 namespace lczero {
@@ -49,6 +56,48 @@ const ChessBoard ChessBoard::kStartposBoard(ChessBoard::kStartposFen);
 
 const BitBoard ChessBoard::kPawnMask = 0x00FFFFFFFFFFFF00ULL;
 
+namespace {
+// Random keys for Zobrist hashing. They come from a fixed splitmix64 sequence,
+// so hashes are the same from run to run.
+struct ZobristKeys {
+  // Indexed by color (white first), piece type and square from white's side.
+  uint64_t pieces[2][6][64];
+  // Indexed by castling rights from white's side, in Castlings bit order.
+  uint64_t castlings[16];
+  // Indexed by en passant file.
+  uint64_t en_passant[8];
+  uint64_t black_to_move;
+};
+
+enum ZobristPiece { kPawn, kKnight, kBishop, kRook, kQueen, kKing };
+
+constexpr ZobristKeys MakeZobristKeys() {
+  ZobristKeys keys{};
+  uint64_t state = 0;
+  auto next = [&state]() {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  };
+  for (auto& color : keys.pieces) {
+    for (auto& piece : color) {
+      for (auto& key : piece) key = next();
+    }
+  }
+  for (auto& key : keys.castlings) key = next();
+  for (auto& key : keys.en_passant) key = next();
+  keys.black_to_move = next();
+  return keys;
+}
+
+constexpr ZobristKeys kZobrist = MakeZobristKeys();
+
+// Squares a castling can change apart from the king's and the rook's source
+// (a1, c1, d1, f1, g1, h1).
+constexpr uint64_t kCastlingSquares = 0xEDULL;
+}  // namespace
+
 void ChessBoard::Clear() {
   std::memset(reinterpret_cast<void*>(this), 0, sizeof(ChessBoard));
 }
@@ -65,114 +114,144 @@ void ChessBoard::Mirror() {
   std::swap(our_king_, their_king_);
   castlings_.Mirror();
   flipped_ = !flipped_;
+  // Keys are computed from white's side, only the side to move changes.
+  key_ ^= kZobrist.black_to_move;
+}
+
+uint64_t ChessBoard::CastlingsKey(uint8_t castlings) const {
+  if (flipped_) castlings = ((castlings & 0b11) << 2) | (castlings >> 2);
+  return kZobrist.castlings[castlings];
+}
+
+uint64_t ChessBoard::StateKey() const {
+  uint64_t key = CastlingsKey(castlings_.as_int());
+  for (auto flag : pawns_ - kPawnMask) key ^= kZobrist.en_passant[flag.col()];
+  if (flipped_) key ^= kZobrist.black_to_move;
+  return key;
+}
+
+void ChessBoard::HashSquares(const BitBoard squares, uint64_t* key,
+                             uint64_t* pawn_key) const {
+  const BitBoard pawns = pawns_ & kPawnMask;
+  for (auto square : squares & (our_pieces_ | their_pieces_)) {
+    // "Ours" are white unless the board is flipped.
+    const int color = our_pieces_.get(square) == flipped_;
+    // Knight, bishop, rook and queen follow the rook and bishop bits.
+    int piece = kKnight + bishops_.get(square) + 2 * rooks_.get(square);
+    if (pawns.get(square)) piece = kPawn;
+    if (square == our_king_ || square == their_king_) piece = kKing;
+    const int absolute = flipped_ ? square.as_int() ^ 56 : square.as_int();
+    const uint64_t piece_key = kZobrist.pieces[color][piece][absolute];
+    *key ^= piece_key;
+    if (piece == kPawn) *pawn_key ^= piece_key;
+  }
+}
+
+uint64_t ChessBoard::ComputeHash() const {
+  uint64_t key = StateKey();
+  uint64_t pawn_key = 0;
+  HashSquares(our_pieces_ | their_pieces_, &key, &pawn_key);
+  return key;
+}
+
+uint64_t ChessBoard::ComputePawnHash() const {
+  uint64_t key = 0;
+  uint64_t pawn_key = 0;
+  HashSquares(pawns_ & kPawnMask, &key, &pawn_key);
+  return pawn_key;
 }
 
 namespace {
-static const std::pair<int, int> kKingMoves[] = {
-    {-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 1}, {1, -1}, {1, 0}, {1, 1}};
+// All attack tables below are generated at compile time. They sit in read-only
+// data, cost nothing at startup and can't be used before being initialized.
 
-static const std::pair<int, int> kRookDirections[] = {
+constexpr std::pair<int, int> kRookDirections[] = {
     {1, 0}, {-1, 0}, {0, 1}, {0, -1}};
 
-static const std::pair<int, int> kBishopDirections[] = {
+constexpr std::pair<int, int> kBishopDirections[] = {
     {1, 1}, {-1, 1}, {1, -1}, {-1, -1}};
 
+// Also the eight directions of a queen.
+constexpr std::pair<int, int> kKingSteps[] = {
+    {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, 1}, {1, -1}, {-1, -1}};
+
+constexpr std::pair<int, int> kKnightSteps[] = {
+    {2, 1}, {2, -1}, {-2, 1}, {-2, -1}, {1, 2}, {1, -2}, {-1, 2}, {-1, -2}};
+
+// Squares of the opponent's pawns attacking a square.
+constexpr std::pair<int, int> kPawnSteps[] = {{1, -1}, {1, 1}};
+
+// Returns the squares from @square in @direction up to the board edge.
+constexpr uint64_t Ray(int square, std::pair<int, int> direction) {
+  uint64_t ray = 0;
+  int row = square / 8 + direction.first;
+  int col = square % 8 + direction.second;
+  while (BoardSquare::IsValid(row, col)) {
+    ray |= BoardSquare(row, col).as_board();
+    row += direction.first;
+    col += direction.second;
+  }
+  return ray;
+}
+
+// Returns for every square the squares a piece on it attacks on an empty
+// board, sliding along @directions or taking a single step.
+template <size_t N>
+constexpr std::array<BitBoard, 64> MakeAttacks(
+    const std::pair<int, int> (&directions)[N], bool slide) {
+  std::array<BitBoard, 64> attacks{};
+  for (int square = 0; square < 64; square++) {
+    uint64_t board = 0;
+    for (const auto& direction : directions) {
+      const int row = square / 8 + direction.first;
+      const int col = square % 8 + direction.second;
+      if (slide) {
+        board |= Ray(square, direction);
+      } else if (BoardSquare::IsValid(row, col)) {
+        board |= BoardSquare(row, col).as_board();
+      }
+    }
+    attacks[square] = board;
+  }
+  return attacks;
+}
+
 // Which squares can rook attack from every of squares.
-static const BitBoard kRookAttacks[] = {
-    0x01010101010101FEULL, 0x02020202020202FDULL, 0x04040404040404FBULL,
-    0x08080808080808F7ULL, 0x10101010101010EFULL, 0x20202020202020DFULL,
-    0x40404040404040BFULL, 0x808080808080807FULL, 0x010101010101FE01ULL,
-    0x020202020202FD02ULL, 0x040404040404FB04ULL, 0x080808080808F708ULL,
-    0x101010101010EF10ULL, 0x202020202020DF20ULL, 0x404040404040BF40ULL,
-    0x8080808080807F80ULL, 0x0101010101FE0101ULL, 0x0202020202FD0202ULL,
-    0x0404040404FB0404ULL, 0x0808080808F70808ULL, 0x1010101010EF1010ULL,
-    0x2020202020DF2020ULL, 0x4040404040BF4040ULL, 0x80808080807F8080ULL,
-    0x01010101FE010101ULL, 0x02020202FD020202ULL, 0x04040404FB040404ULL,
-    0x08080808F7080808ULL, 0x10101010EF101010ULL, 0x20202020DF202020ULL,
-    0x40404040BF404040ULL, 0x808080807F808080ULL, 0x010101FE01010101ULL,
-    0x020202FD02020202ULL, 0x040404FB04040404ULL, 0x080808F708080808ULL,
-    0x101010EF10101010ULL, 0x202020DF20202020ULL, 0x404040BF40404040ULL,
-    0x8080807F80808080ULL, 0x0101FE0101010101ULL, 0x0202FD0202020202ULL,
-    0x0404FB0404040404ULL, 0x0808F70808080808ULL, 0x1010EF1010101010ULL,
-    0x2020DF2020202020ULL, 0x4040BF4040404040ULL, 0x80807F8080808080ULL,
-    0x01FE010101010101ULL, 0x02FD020202020202ULL, 0x04FB040404040404ULL,
-    0x08F7080808080808ULL, 0x10EF101010101010ULL, 0x20DF202020202020ULL,
-    0x40BF404040404040ULL, 0x807F808080808080ULL, 0xFE01010101010101ULL,
-    0xFD02020202020202ULL, 0xFB04040404040404ULL, 0xF708080808080808ULL,
-    0xEF10101010101010ULL, 0xDF20202020202020ULL, 0xBF40404040404040ULL,
-    0x7F80808080808080ULL};
+constexpr std::array<BitBoard, 64> kRookAttacks =
+    MakeAttacks(kRookDirections, true);
 // Which squares can bishop attack.
-static const BitBoard kBishopAttacks[] = {
-    0x8040201008040200ULL, 0x0080402010080500ULL, 0x0000804020110A00ULL,
-    0x0000008041221400ULL, 0x0000000182442800ULL, 0x0000010204885000ULL,
-    0x000102040810A000ULL, 0x0102040810204000ULL, 0x4020100804020002ULL,
-    0x8040201008050005ULL, 0x00804020110A000AULL, 0x0000804122140014ULL,
-    0x0000018244280028ULL, 0x0001020488500050ULL, 0x0102040810A000A0ULL,
-    0x0204081020400040ULL, 0x2010080402000204ULL, 0x4020100805000508ULL,
-    0x804020110A000A11ULL, 0x0080412214001422ULL, 0x0001824428002844ULL,
-    0x0102048850005088ULL, 0x02040810A000A010ULL, 0x0408102040004020ULL,
-    0x1008040200020408ULL, 0x2010080500050810ULL, 0x4020110A000A1120ULL,
-    0x8041221400142241ULL, 0x0182442800284482ULL, 0x0204885000508804ULL,
-    0x040810A000A01008ULL, 0x0810204000402010ULL, 0x0804020002040810ULL,
-    0x1008050005081020ULL, 0x20110A000A112040ULL, 0x4122140014224180ULL,
-    0x8244280028448201ULL, 0x0488500050880402ULL, 0x0810A000A0100804ULL,
-    0x1020400040201008ULL, 0x0402000204081020ULL, 0x0805000508102040ULL,
-    0x110A000A11204080ULL, 0x2214001422418000ULL, 0x4428002844820100ULL,
-    0x8850005088040201ULL, 0x10A000A010080402ULL, 0x2040004020100804ULL,
-    0x0200020408102040ULL, 0x0500050810204080ULL, 0x0A000A1120408000ULL,
-    0x1400142241800000ULL, 0x2800284482010000ULL, 0x5000508804020100ULL,
-    0xA000A01008040201ULL, 0x4000402010080402ULL, 0x0002040810204080ULL,
-    0x0005081020408000ULL, 0x000A112040800000ULL, 0x0014224180000000ULL,
-    0x0028448201000000ULL, 0x0050880402010000ULL, 0x00A0100804020100ULL,
-    0x0040201008040201ULL};
+constexpr std::array<BitBoard, 64> kBishopAttacks =
+    MakeAttacks(kBishopDirections, true);
 // Which squares can knight attack.
-static const BitBoard kKnightAttacks[] = {
-    0x0000000000020400ULL, 0x0000000000050800ULL, 0x00000000000A1100ULL,
-    0x0000000000142200ULL, 0x0000000000284400ULL, 0x0000000000508800ULL,
-    0x0000000000A01000ULL, 0x0000000000402000ULL, 0x0000000002040004ULL,
-    0x0000000005080008ULL, 0x000000000A110011ULL, 0x0000000014220022ULL,
-    0x0000000028440044ULL, 0x0000000050880088ULL, 0x00000000A0100010ULL,
-    0x0000000040200020ULL, 0x0000000204000402ULL, 0x0000000508000805ULL,
-    0x0000000A1100110AULL, 0x0000001422002214ULL, 0x0000002844004428ULL,
-    0x0000005088008850ULL, 0x000000A0100010A0ULL, 0x0000004020002040ULL,
-    0x0000020400040200ULL, 0x0000050800080500ULL, 0x00000A1100110A00ULL,
-    0x0000142200221400ULL, 0x0000284400442800ULL, 0x0000508800885000ULL,
-    0x0000A0100010A000ULL, 0x0000402000204000ULL, 0x0002040004020000ULL,
-    0x0005080008050000ULL, 0x000A1100110A0000ULL, 0x0014220022140000ULL,
-    0x0028440044280000ULL, 0x0050880088500000ULL, 0x00A0100010A00000ULL,
-    0x0040200020400000ULL, 0x0204000402000000ULL, 0x0508000805000000ULL,
-    0x0A1100110A000000ULL, 0x1422002214000000ULL, 0x2844004428000000ULL,
-    0x5088008850000000ULL, 0xA0100010A0000000ULL, 0x4020002040000000ULL,
-    0x0400040200000000ULL, 0x0800080500000000ULL, 0x1100110A00000000ULL,
-    0x2200221400000000ULL, 0x4400442800000000ULL, 0x8800885000000000ULL,
-    0x100010A000000000ULL, 0x2000204000000000ULL, 0x0004020000000000ULL,
-    0x0008050000000000ULL, 0x00110A0000000000ULL, 0x0022140000000000ULL,
-    0x0044280000000000ULL, 0x0088500000000000ULL, 0x0010A00000000000ULL,
-    0x0020400000000000ULL};
-// Opponent pawn attacks
-static const BitBoard kPawnAttacks[] = {
-    0x0000000000000200ULL, 0x0000000000000500ULL, 0x0000000000000A00ULL,
-    0x0000000000001400ULL, 0x0000000000002800ULL, 0x0000000000005000ULL,
-    0x000000000000A000ULL, 0x0000000000004000ULL, 0x0000000000020000ULL,
-    0x0000000000050000ULL, 0x00000000000A0000ULL, 0x0000000000140000ULL,
-    0x0000000000280000ULL, 0x0000000000500000ULL, 0x0000000000A00000ULL,
-    0x0000000000400000ULL, 0x0000000002000000ULL, 0x0000000005000000ULL,
-    0x000000000A000000ULL, 0x0000000014000000ULL, 0x0000000028000000ULL,
-    0x0000000050000000ULL, 0x00000000A0000000ULL, 0x0000000040000000ULL,
-    0x0000000200000000ULL, 0x0000000500000000ULL, 0x0000000A00000000ULL,
-    0x0000001400000000ULL, 0x0000002800000000ULL, 0x0000005000000000ULL,
-    0x000000A000000000ULL, 0x0000004000000000ULL, 0x0000020000000000ULL,
-    0x0000050000000000ULL, 0x00000A0000000000ULL, 0x0000140000000000ULL,
-    0x0000280000000000ULL, 0x0000500000000000ULL, 0x0000A00000000000ULL,
-    0x0000400000000000ULL, 0x0002000000000000ULL, 0x0005000000000000ULL,
-    0x000A000000000000ULL, 0x0014000000000000ULL, 0x0028000000000000ULL,
-    0x0050000000000000ULL, 0x00A0000000000000ULL, 0x0040000000000000ULL,
-    0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
-    0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
-    0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
-    0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
-    0x0000000000000000ULL, 0x0000000000000000ULL, 0x0000000000000000ULL,
-    0x0000000000000000ULL};
+constexpr std::array<BitBoard, 64> kKnightAttacks =
+    MakeAttacks(kKnightSteps, false);
+// Which squares can king attack.
+constexpr std::array<BitBoard, 64> kKingAttacks =
+    MakeAttacks(kKingSteps, false);
+// Opponent pawn attacks. Pawns never stand on the last rank, where pawns_
+// holds the en passant flags instead.
+constexpr std::array<BitBoard, 64> kPawnAttacks = [] {
+  auto attacks = MakeAttacks(kPawnSteps, false);
+  for (auto& board : attacks) board = board.as_int() & ~0xFF00000000000000ULL;
+  return attacks;
+}();
+// Our pawn attacks, the squares of our pawns attacking a square. Rank 1 holds
+// their en passant flags instead of pawns.
+constexpr std::array<BitBoard, 64> kOurPawnAttacks = [] {
+  constexpr std::pair<int, int> kOurPawnSteps[] = {{-1, -1}, {-1, 1}};
+  auto attacks = MakeAttacks(kOurPawnSteps, false);
+  for (auto& board : attacks) board = board.as_int() & ~0xFFULL;
+  return attacks;
+}();
+
+// Piece values of the static exchange evaluation. The king's is higher than
+// any exchange can win, so capturing it ends the exchange.
+constexpr int kSEEPawnValue = 100;
+constexpr int kSEEKnightValue = 300;
+constexpr int kSEEBishopValue = 300;
+constexpr int kSEERookValue = 500;
+constexpr int kSEEQueenValue = 900;
+constexpr int kSEEKingValue = 20000;
 
 static const Move::Promotion kPromotions[] = {
     Move::Promotion::Queen,
@@ -181,28 +260,82 @@ static const Move::Promotion kPromotions[] = {
     Move::Promotion::Knight,
 };
 
-// Magic bitboard routines and structures.
-// We use so-called "fancy" magic bitboards.
-
-// Structure holding all relevant magic parameters per square.
-struct MagicParams {
-  // Relevant occupancy mask.
-  uint64_t mask_;
-  // Pointer to lookup table.
-  BitBoard* attacks_table_;
-#if defined(NO_PEXT)
-  // Magic number.
-  uint64_t magic_number_;
-  // Number of bits to shift.
-  uint8_t shift_bits_;
-#endif
+// Sliding piece attacks have three backends, picked at startup to suit the
+// CPU (see SliderBackend):
+//  - pext: the relevant occupancy is extracted with pext into an index of
+//    the square's attacks table, on CPUs with fast BMI2.
+//  - magic: so-called "fancy" magic bitboards, the same tables indexed by
+//    multiplication with a magic number.
+//  - portable: no large tables, each ray is cut behind its first blocker with
+//    a bit scan.
+
+// Rays from every square in the four directions of a rook or bishop.
+struct SliderRays {
+  uint64_t rays_[4][64];
+  // Whether the direction goes to higher squares, where the first blocker is
+  // the lowest set bit.
+  bool up_[4];
 };
 
-#if defined(NO_PEXT)
+constexpr SliderRays MakeSliderRays(
+    const std::pair<int, int> (&directions)[4]) {
+  SliderRays rays{};
+  for (int i = 0; i < 4; i++) {
+    rays.up_[i] = directions[i].first * 8 + directions[i].second > 0;
+    for (int square = 0; square < 64; square++) {
+      rays.rays_[i][square] = Ray(square, directions[i]);
+    }
+  }
+  return rays;
+}
+
+constexpr SliderRays kRookRays = MakeSliderRays(kRookDirections);
+constexpr SliderRays kBishopRays = MakeSliderRays(kBishopDirections);
+
+// Returns the attacks of a slider on @square, given the occupied squares.
+// Builds the tables below too.
+constexpr uint64_t RayAttacks(const SliderRays& rays, int square,
+                              uint64_t occupied) {
+  uint64_t attacks = 0;
+  for (int i = 0; i < 4; i++) {
+    const uint64_t ray = rays.rays_[i][square];
+    const uint64_t blockers = ray & occupied;
+    attacks |= ray;
+    if (!blockers) continue;
+    attacks ^= rays.rays_[i][rays.up_[i] ? __builtin_ctzll(blockers)
+                                         : 63 - __builtin_clzll(blockers)];
+  }
+  return attacks;
+}
+
+// Returns the occupancy relevant to the attacks from @square: the rays without
+// their last square on the board edge.
+constexpr uint64_t RelevantOccupancy(const SliderRays& rays, int square) {
+  uint64_t mask = 0;
+  for (int i = 0; i < 4; i++) {
+    const uint64_t ray = rays.rays_[i][square];
+    if (!ray) continue;
+    mask |= ray & ~(1ULL << (rays.up_[i] ? 63 - __builtin_clzll(ray)
+                                         : __builtin_ctzll(ray)));
+  }
+  return mask;
+}
+
+// Calls @fn with every subset of @mask in increasing order, which is also the
+// order of their pext indices.
+template <typename Fn>
+constexpr void ForEachSubset(uint64_t mask, Fn fn) {
+  uint64_t subset = 0;
+  do {
+    fn(subset);
+    subset = (subset - mask) & mask;
+  } while (subset);
+}
+
 // Magic numbers determined via trial and error with random number generator
 // such that the number of relevant occupancy bits suffice to index the attacks
 // tables with only constructive collisions.
-static const BitBoard kRookMagicNumbers[] = {
+constexpr uint64_t kRookMagicNumbers[] = {
     0x088000102088C001ULL, 0x10C0200040001000ULL, 0x83001041000B2000ULL,
     0x0680280080041000ULL, 0x488004000A080080ULL, 0x0100180400010002ULL,
     0x040001C401021008ULL, 0x02000C04A980C302ULL, 0x0000800040082084ULL,
@@ -225,7 +358,7 @@ static const BitBoard kRookMagicNumbers[] = {
     0x2001008440001021ULL, 0x2002008830204082ULL, 0x0010145000082101ULL,
     0x01A2001004200842ULL, 0x1007000608040041ULL, 0x000A08100203028CULL,
     0x02D4048040290402ULL};
-static const BitBoard kBishopMagicNumbers[] = {
+constexpr uint64_t kBishopMagicNumbers[] = {
     0x0008201802242020ULL, 0x0021040424806220ULL, 0x4006360602013080ULL,
     0x0004410020408002ULL, 0x2102021009001140ULL, 0x08C2021004000001ULL,
     0x6001031120200820ULL, 0x1018310402201410ULL, 0x401CE00210820484ULL,
@@ -248,325 +381,755 @@ static const BitBoard kBishopMagicNumbers[] = {
     0x11840044440C2080ULL, 0x2802A02104030440ULL, 0x6100000900840401ULL,
     0x1C20A15A90420200ULL, 0x0088414004480280ULL, 0x0000204242881100ULL,
     0x0240080802809010ULL};
-#endif
 
-// Magic parameters for rooks/bishops.
-static MagicParams rook_magic_params[64];
-static MagicParams bishop_magic_params[64];
+// Structure holding all relevant magic parameters per square.
+struct MagicParams {
+  // Relevant occupancy mask.
+  uint64_t mask_;
+  // Magic number.
+  uint64_t magic_number_;
+  // Offset of the square's entries in the attacks table.
+  uint32_t offset_;
+  // Number of bits to shift.
+  uint8_t shift_bits_;
+};
 
-// Precomputed attacks bitboard tables.
-static BitBoard rook_attacks_table[102400];
-static BitBoard bishop_attacks_table[5248];
+// Magic parameters and attacks table of rooks or bishops.
+template <size_t kSize>
+struct MagicTable {
+  MagicParams params_[64];
+  uint64_t attacks_[kSize];
+};
 
-// Builds rook or bishop attacks table.
-static void BuildAttacksTable(MagicParams* magic_params,
-                              BitBoard* attacks_table,
-                              const std::pair<int, int>* directions) {
+// Builds rook or bishop magic attacks table.
+template <size_t kSize>
+constexpr MagicTable<kSize> MakeMagicTable(const SliderRays& rays,
+                                           const uint64_t* magic_numbers) {
+  MagicTable<kSize> table{};
   // Offset into lookup table.
   uint32_t table_offset = 0;
+  for (int square = 0; square < 64; square++) {
+    MagicParams& params = table.params_[square];
+    params.mask_ = RelevantOccupancy(rays, square);
+    params.offset_ = table_offset;
+    // The magic numbers have been chosen such that the number of relevant
+    // occupancy bits suffice to index the attacks table.
+    const int bits = __builtin_popcountll(params.mask_);
+    params.magic_number_ = magic_numbers[square];
+    params.shift_bits_ = 64 - bits;
 
-  // Initialize for all board squares.
-  for (unsigned square = 0; square < 64; square++) {
-    const BoardSquare b_sq(square);
-
-    // Calculate relevant occupancy masks.
-    BitBoard mask = {0};
-
-    for (int j = 0; j < 4; j++) {
-      auto direction = directions[j];
-      auto dst_row = b_sq.row();
-      auto dst_col = b_sq.col();
-      while (true) {
-        dst_row += direction.first;
-        dst_col += direction.second;
-        // If the next square in this direction is invalid, the current square
-        // is at the board's edge and should not be added.
-        if (!BoardSquare::IsValid(dst_row + direction.first,
-                                  dst_col + direction.second))
-          break;
-        const BoardSquare destination(dst_row, dst_col);
-        mask.set(destination);
+    // Build square attacks table for every possible relevant occupancy
+    // bitboard.
+    ForEachSubset(params.mask_, [&](uint64_t occupancy) {
+      const uint64_t attacks = RayAttacks(rays, square, occupancy);
+      const uint64_t index =
+          (occupancy * params.magic_number_) >> params.shift_bits_;
+      // Sanity check. If the table already contains an attacks bitboard,
+      // possible collisions should be constructive.
+      uint64_t& entry = table.attacks_[table_offset + index];
+      if (entry != 0 && entry != attacks) {
+        throw Exception("Invalid magic number!");
       }
-    }
-
-    // Set mask.
-    magic_params[square].mask_ = mask.as_int();
+      entry = attacks;
+    });
+    table_offset += 1 << bits;
+  }
+  return table;
+}
 
-    // Cache relevant occupancy board squares.
-    std::vector<BoardSquare> occupancy_squares;
+constexpr MagicTable<102400> kRookMagicTable =
+    MakeMagicTable<102400>(kRookRays, kRookMagicNumbers);
+constexpr MagicTable<5248> kBishopMagicTable =
+    MakeMagicTable<5248>(kBishopRays, kBishopMagicNumbers);
+
+template <size_t kSize>
+inline uint64_t MagicAttacks(const MagicTable<kSize>& table,
+                             const BoardSquare square, const BitBoard pieces) {
+  const MagicParams& params = table.params_[square.as_int()];
+  uint64_t index = pieces.as_int() & params.mask_;
+  index *= params.magic_number_;
+  index >>= params.shift_bits_;
+  return table.attacks_[params.offset_ + index];
+}
 
-    for (auto occ_sq : BitBoard(magic_params[square].mask_)) {
-      occupancy_squares.emplace_back(occ_sq);
-    }
+#if !defined(NO_PEXT)
+#if defined(COMPRESSED_PEXT)
+// Attack sets packed with pext against the square's empty board attacks, which
+// take at most 14 bits. A quarter of the size of full bitboards, so the tables
+// stay in L2 next to the search.
+using PextEntry = uint16_t;
+#else
+using PextEntry = uint64_t;
+#endif
 
-#if defined(NO_PEXT)
-    // Set number of shifted bits. The magic numbers have been chosen such that
-    // the number of relevant occupancy bits suffice to index the attacks table.
-    magic_params[square].shift_bits_ = 64 - occupancy_squares.size();
+struct PextParams {
+  // Relevant occupancy mask.
+  uint64_t mask_;
+#if defined(COMPRESSED_PEXT)
+  // Attacks on the empty board, the mask to unpack table entries with pdep.
+  uint64_t attacks_mask_;
 #endif
+  // Offset of the square's entries in the attacks table.
+  uint32_t offset_;
+};
 
-    // Set pointer to lookup table.
-    magic_params[square].attacks_table_ = &attacks_table[table_offset];
+template <size_t kSize>
+struct PextTable {
+  PextParams params_[64];
+  PextEntry attacks_[kSize];
+};
 
-    // Clear attacks table (used for sanity check later on).
-    for (int i = 0; i < (1 << occupancy_squares.size()); i++) {
-      attacks_table[table_offset + i] = 0;
-    }
+// Software pext, for building the tables at compile time.
+constexpr uint64_t Pext(uint64_t value, uint64_t mask) {
+  uint64_t result = 0;
+  for (uint64_t bit = 1; mask; mask &= mask - 1, bit <<= 1) {
+    if (value & mask & -mask) result |= bit;
+  }
+  return result;
+}
 
-    // Build square attacks table for every possible relevant occupancy
-    // bitboard.
-    for (int i = 0; i < (1 << occupancy_squares.size()); i++) {
-      BitBoard occupancy(0);
+// Builds rook or bishop pext attacks table.
+template <size_t kSize>
+constexpr PextTable<kSize> MakePextTable(const SliderRays& rays) {
+  PextTable<kSize> table{};
+  uint32_t table_offset = 0;
+  for (int square = 0; square < 64; square++) {
+    PextParams& params = table.params_[square];
+    params.mask_ = RelevantOccupancy(rays, square);
+    params.offset_ = table_offset;
+#if defined(COMPRESSED_PEXT)
+    params.attacks_mask_ = RayAttacks(rays, square, 0);
+#endif
+    ForEachSubset(params.mask_, [&](uint64_t occupancy) {
+      const uint64_t attacks = RayAttacks(rays, square, occupancy);
+#if defined(COMPRESSED_PEXT)
+      table.attacks_[table_offset++] = Pext(attacks, params.attacks_mask_);
+#else
+      table.attacks_[table_offset++] = attacks;
+#endif
+    });
+  }
+  return table;
+}
 
-      for (size_t bit = 0; bit < occupancy_squares.size(); bit++) {
-        occupancy.set_if(occupancy_squares[bit], (1 << bit) & i);
-      }
+constexpr PextTable<102400> kRookPextTable = MakePextTable<102400>(kRookRays);
+constexpr PextTable<5248> kBishopPextTable = MakePextTable<5248>(kBishopRays);
 
-      // Calculate attacks bitboard corresponding to this occupancy bitboard.
-      BitBoard attacks(0);
-
-      for (int j = 0; j < 4; j++) {
-        auto direction = directions[j];
-        auto dst_row = b_sq.row();
-        auto dst_col = b_sq.col();
-        while (true) {
-          dst_row += direction.first;
-          dst_col += direction.second;
-          if (!BoardSquare::IsValid(dst_row, dst_col)) break;
-          const BoardSquare destination(dst_row, dst_col);
-          attacks.set(destination);
-          if (occupancy.get(destination)) break;
-        }
-      }
+// pext and pdep through inline assembly rather than the BMI2 intrinsics, which
+// can only be inlined into code built for BMI2. Only reached once the CPU is
+// known to have them.
+inline uint64_t PextInstruction(uint64_t value, uint64_t mask) {
+  uint64_t result;
+  asm("pext %2, %1, %0" : "=r"(result) : "r"(value), "r"(mask));
+  return result;
+}
 
-#if defined(NO_PEXT)
-      // Calculate magic index.
-      uint64_t index = occupancy.as_int();
-      index *= magic_params[square].magic_number_;
-      index >>= magic_params[square].shift_bits_;
-
-      // Sanity check. The magic numbers have been chosen such that
-      // the number of relevant occupancy bits suffice to index the attacks
-      // table. If the table already contains an attacks bitboard, possible
-      // collisions should be constructive.
-      if (attacks_table[table_offset + index] != 0 &&
-          attacks_table[table_offset + index] != attacks) {
-        throw Exception("Invalid magic number!");
-      }
+#if defined(COMPRESSED_PEXT)
+inline uint64_t PdepInstruction(uint64_t value, uint64_t mask) {
+  uint64_t result;
+  asm("pdep %2, %1, %0" : "=r"(result) : "r"(value), "r"(mask));
+  return result;
+}
+#endif
+
+template <size_t kSize>
+inline uint64_t PextAttacks(const PextTable<kSize>& table,
+                            const BoardSquare square, const BitBoard pieces) {
+  const PextParams& params = table.params_[square.as_int()];
+  const uint64_t index = PextInstruction(pieces.as_int(), params.mask_);
+  const PextEntry attacks = table.attacks_[params.offset_ + index];
+#if defined(COMPRESSED_PEXT)
+  return PdepInstruction(attacks, params.attacks_mask_);
 #else
-      uint64_t index =
-          _pext_u64(occupancy.as_int(), magic_params[square].mask_);
+  return attacks;
+#endif
+}
 #endif
 
-      // Update table.
-      attacks_table[table_offset + index] = attacks;
-    }
+SliderBackend BestSliderBackend() {
+  if (IsSliderBackendSupported(SliderBackend::kPext) &&
+      GetCpuFeatures().fast_pext) {
+    return SliderBackend::kPext;
+  }
+  return SliderBackend::kMagic;
+}
+
+// Zero, i.e. kPortable, until static initialization gets here.
+SliderBackend slider_backend = BestSliderBackend();
 
-    // Update table offset.
-    table_offset += (1 << occupancy_squares.size());
+// Returns the attacks bitboard of a rook or bishop on @square through the
+// active backend, given the occupied piece bitboard.
+template <size_t kSize>
+#if defined(NO_PEXT)
+inline BitBoard GetSliderAttacks(const MagicTable<kSize>& magic_table,
+                                 const SliderRays& rays,
+                                 const BoardSquare square,
+                                 const BitBoard pieces) {
+#else
+inline BitBoard GetSliderAttacks(const PextTable<kSize>& pext_table,
+                                 const MagicTable<kSize>& magic_table,
+                                 const SliderRays& rays,
+                                 const BoardSquare square,
+                                 const BitBoard pieces) {
+  if (slider_backend == SliderBackend::kPext) {
+    return PextAttacks(pext_table, square, pieces);
   }
+#endif
+  if (slider_backend == SliderBackend::kMagic) {
+    return MagicAttacks(magic_table, square, pieces);
+  }
+  return RayAttacks(rays, square.as_int(), pieces.as_int());
 }
 
 // Returns the rook attacks bitboard for the given rook board square and the
 // given occupied piece bitboard.
 static inline BitBoard GetRookAttacks(const BoardSquare rook_square,
                                       const BitBoard pieces) {
-  // Calculate magic index.
-  const uint8_t square = rook_square.as_int();
-
 #if defined(NO_PEXT)
-  uint64_t index = pieces.as_int() & rook_magic_params[square].mask_;
-  index *= rook_magic_params[square].magic_number_;
-  index >>= rook_magic_params[square].shift_bits_;
+  return GetSliderAttacks(kRookMagicTable, kRookRays, rook_square, pieces);
 #else
-  uint64_t index = _pext_u64(pieces.as_int(), rook_magic_params[square].mask_);
+  return GetSliderAttacks(kRookPextTable, kRookMagicTable, kRookRays,
+                          rook_square, pieces);
 #endif
-
-  // Return attacks bitboard.
-  return rook_magic_params[square].attacks_table_[index];
 }
 
 // Returns the bishop attacks bitboard for the given bishop board square and
 // the given occupied piece bitboard.
 static inline BitBoard GetBishopAttacks(const BoardSquare bishop_square,
                                         const BitBoard pieces) {
-  // Calculate magic index.
-  const uint8_t square = bishop_square.as_int();
-
 #if defined(NO_PEXT)
-  uint64_t index = pieces.as_int() & bishop_magic_params[square].mask_;
-  index *= bishop_magic_params[square].magic_number_;
-  index >>= bishop_magic_params[square].shift_bits_;
+  return GetSliderAttacks(kBishopMagicTable, kBishopRays, bishop_square,
+                          pieces);
 #else
-  uint64_t index =
-      _pext_u64(pieces.as_int(), bishop_magic_params[square].mask_);
+  return GetSliderAttacks(kBishopPextTable, kBishopMagicTable, kBishopRays,
+                          bishop_square, pieces);
 #endif
+}
+
+// Squares strictly between two squares sharing a rank, file or diagonal, and
+// the whole line through them, edge to edge. Both are empty for squares which
+// are not aligned.
+struct LineTables {
+  uint64_t between_[64][64];
+  uint64_t line_[64][64];
+};
+
+constexpr LineTables MakeLineTables() {
+  LineTables tables{};
+  for (int square = 0; square < 64; square++) {
+    for (const auto& direction : kKingSteps) {
+      const uint64_t line = Ray(square, direction) |
+                            Ray(square, {-direction.first, -direction.second}) |
+                            BoardSquare(square).as_board();
+      uint64_t between = 0;
+      int row = square / 8 + direction.first;
+      int col = square % 8 + direction.second;
+      while (BoardSquare::IsValid(row, col)) {
+        const int other = row * 8 + col;
+        tables.between_[square][other] = between;
+        tables.line_[square][other] = line;
+        between |= BoardSquare(other).as_board();
+        row += direction.first;
+        col += direction.second;
+      }
+    }
+  }
+  return tables;
+}
+
+constexpr LineTables kLineTables = MakeLineTables();
+
+static inline BitBoard Between(const BoardSquare a, const BoardSquare b) {
+  return kLineTables.between_[a.as_int()][b.as_int()];
+}
 
-  // Return attacks bitboard.
-  return bishop_magic_params[square].attacks_table_[index];
+static inline BitBoard Line(const BoardSquare a, const BoardSquare b) {
+  return kLineTables.line_[a.as_int()][b.as_int()];
 }
 
+// Returns the pieces which are the only piece of @occupied between @king and
+// one of @snipers. Those are pinned, or can give discovered check.
+static inline BitBoard SoleBlockers(const BoardSquare king,
+                                    const BitBoard snipers,
+                                    const BitBoard occupied) {
+  BitBoard blockers;
+  for (auto sniper : snipers) {
+    const uint64_t between = (Between(king, sniper) & occupied).as_int();
+    if (between && !(between & (between - 1))) blockers = blockers | between;
+  }
+  return blockers;
+}
+
+constexpr uint64_t kFileA = 0x0101010101010101ULL;
+constexpr uint64_t kFileH = 0x8080808080808080ULL;
+constexpr uint64_t kRank3 = 0x0000000000FF0000ULL;
+constexpr uint64_t kRank8 = 0xFF00000000000000ULL;
+
+// Squares of the first rank from @a to @b inclusive, in any order.
+inline uint64_t FirstRankSpan(uint8_t a, uint8_t b) {
+  return (2ULL << std::max(a, b)) - (1ULL << std::min(a, b));
+}
+
+// Adds a move from @source to every square of @destinations.
+inline void AddMoves(BoardSquare source, BitBoard destinations,
+                     MoveList* moves) {
+  for (auto destination : destinations) {
+    moves->emplace_back(source, destination);
+  }
+}
 }  // namespace
 
-void InitializeMagicBitboards() {
+bool IsSliderBackendSupported(SliderBackend backend) {
+  switch (backend) {
+    case SliderBackend::kPext:
 #if defined(NO_PEXT)
-  // Set magic numbers for all board squares.
-  for (unsigned square = 0; square < 64; square++) {
-    rook_magic_params[square].magic_number_ =
-        kRookMagicNumbers[square].as_int();
-    bishop_magic_params[square].magic_number_ =
-        kBishopMagicNumbers[square].as_int();
+      return false;
+#else
+      return GetCpuFeatures().bmi2;
+#endif
+    case SliderBackend::kMagic:
+    case SliderBackend::kPortable:
+      return true;
+  }
+  return false;
+}
+
+SliderBackend GetSliderBackend() { return slider_backend; }
+
+void SetSliderBackend(SliderBackend backend) {
+  if (!IsSliderBackendSupported(backend)) {
+    throw Exception(std::string("Slider backend not supported: ") +
+                    SliderBackendName(backend));
   }
+  slider_backend = backend;
+}
+
+const char* SliderBackendName(SliderBackend backend) {
+  switch (backend) {
+    case SliderBackend::kPext:
+#if defined(COMPRESSED_PEXT)
+      return "pext16";
+#else
+      return "pext";
 #endif
+    case SliderBackend::kMagic:
+      return "magic";
+    case SliderBackend::kPortable:
+      return "portable";
+  }
+  return "unknown";
+}
 
-  // Build attacks tables.
-  BuildAttacksTable(rook_magic_params, rook_attacks_table, kRookDirections);
-  BuildAttacksTable(bishop_magic_params, bishop_attacks_table,
-                    kBishopDirections);
+std::string BackendsDebugString() {
+  // Mirrors BitBoard::count().
+#if defined(NO_POPCNT)
+  const char* popcount = "portable";
+#elif defined(__x86_64__) && !defined(__POPCNT__)
+  const char* popcount = kCpuHasPopcnt ? "popcnt" : "portable";
+#elif defined(__POPCNT__)
+  const char* popcount = "popcnt";
+#else
+  const char* popcount = "builtin";
+#endif
+  return std::string("slider attacks ") + SliderBackendName(slider_backend) +
+         ", popcount " + popcount + ", cpu " + GetCpuFeatures().DebugString();
 }
 
-MoveList ChessBoard::GeneratePseudolegalMoves() const {
-  MoveList result;
-  result.reserve(60);
-  for (auto source : our_pieces_) {
-    // King
-    if (source == our_king_) {
-      for (const auto& delta : kKingMoves) {
-        const auto dst_row = source.row() + delta.first;
-        const auto dst_col = source.col() + delta.second;
-        if (!BoardSquare::IsValid(dst_row, dst_col)) continue;
-        const BoardSquare destination(dst_row, dst_col);
-        if (our_pieces_.get(destination)) continue;
-        if (IsUnderAttack(destination)) continue;
-        result.emplace_back(source, destination);
+BitBoard RookAttacks(const BoardSquare square, const BitBoard occupied) {
+  return GetRookAttacks(square, occupied);
+}
+
+BitBoard BishopAttacks(const BoardSquare square, const BitBoard occupied) {
+  return GetBishopAttacks(square, occupied);
+}
+
+BitBoard ChessBoard::TheirAttacks(const BitBoard occupied) const {
+  // Their pawns capture downwards.
+  const uint64_t their_pawns = (their_pieces_ & pawns_ & kPawnMask).as_int();
+  BitBoard attacks = ((their_pawns & ~kFileA) >> 9) |
+                     ((their_pawns & ~kFileH) >> 7) |
+                     kKingAttacks[their_king_.as_int()].as_int();
+  for (auto source : their_pieces_ - their_king_ - rooks_ - bishops_ -
+                         (pawns_ & kPawnMask)) {
+    attacks = attacks | kKnightAttacks[source.as_int()];
+  }
+  for (auto source : their_pieces_ & rooks_) {
+    attacks = attacks | GetRookAttacks(source, occupied);
+  }
+  for (auto source : their_pieces_ & bishops_) {
+    attacks = attacks | GetBishopAttacks(source, occupied);
+  }
+  return attacks;
+}
+
+BitBoard ChessBoard::TheirAttacks() const {
+  return TheirAttacks((our_pieces_ - our_king_) | their_pieces_);
+}
+
+AttackMap ChessBoard::GetAttackMap() const {
+  const BitBoard occupied = (our_pieces_ - our_king_) | their_pieces_;
+  AttackMap map;
+  const uint64_t their_pawns = (their_pieces_ & pawns_ & kPawnMask).as_int();
+  map.pawns = ((their_pawns & ~kFileA) >> 9) | ((their_pawns & ~kFileH) >> 7);
+  for (auto source : their_pieces_ - their_king_ - rooks_ - bishops_ -
+                         (pawns_ & kPawnMask)) {
+    map.knights = map.knights | kKnightAttacks[source.as_int()];
+  }
+  for (auto source : their_pieces_ & (bishops_ - rooks_)) {
+    map.bishops = map.bishops | GetBishopAttacks(source, occupied);
+  }
+  for (auto source : their_pieces_ & (rooks_ - bishops_)) {
+    map.rooks = map.rooks | GetRookAttacks(source, occupied);
+  }
+  for (auto source : their_pieces_ & rooks_ & bishops_) {
+    map.queens = map.queens | GetBishopAttacks(source, occupied) |
+                 GetRookAttacks(source, occupied);
+  }
+  map.king = kKingAttacks[their_king_.as_int()];
+  return map;
+}
+
+CheckInfo ChessBoard::GenerateCheckInfo() const {
+  CheckInfo info;
+  const BitBoard occupied = our_pieces_ | their_pieces_;
+  const uint8_t king = their_king_.as_int();
+  // Our pawns capture upwards, so they check from diagonally below the king.
+  const uint64_t king_board = their_king_.as_board();
+  info.pawn_checks_ =
+      ((king_board & ~kFileA) >> 9) | ((king_board & ~kFileH) >> 7);
+  info.knight_checks_ = kKnightAttacks[king];
+  info.bishop_checks_ = GetBishopAttacks(their_king_, occupied);
+  info.rook_checks_ = GetRookAttacks(their_king_, occupied);
+
+  const BitBoard snipers = (kRookAttacks[king] & our_pieces_ & rooks_) |
+                           (kBishopAttacks[king] & our_pieces_ & bishops_);
+  info.discovered_candidates_ =
+      SoleBlockers(their_king_, snipers, occupied) & our_pieces_;
+  return info;
+}
+
+template <ChessBoard::GenType kType, typename Moves>
+void ChessBoard::GenerateMoves(Moves* moves) const {
+  constexpr bool kLegal = kType != GenType::kPseudolegal;
+  // Captures and queen promotions.
+  constexpr bool kCaptures =
+      kType != GenType::kQuiets && kType != GenType::kQuietChecks;
+  // Non-captures, castlings and underpromotions.
+  constexpr bool kQuiets = kType != GenType::kCaptures;
+  // Only the quiet moves which give check.
+  constexpr bool kChecks = kType == GenType::kQuietChecks;
+  // Moves are counted by piece type rather than listed.
+  constexpr bool kCount = std::is_same_v<Moves, Mobility>;
+  // Returns as soon as a group of moves adds to the count.
+  constexpr bool kAny = kType == GenType::kAnyLegal;
+
+  const BitBoard occupied = our_pieces_ | their_pieces_;
+  const uint8_t king = our_king_.as_int();
+
+  // Squares a non-king move has to land on: anywhere when not in check, the
+  // checker or a square between it and the king in single check, and nowhere
+  // in double check. Pseudolegal generation ignores checks.
+  uint64_t check_mask = ~0ULL;
+  // Knight and pawn checkers are kept apart for the en passant test.
+  BitBoard stepper_checkers;
+  BitBoard checkers;
+  // Pinned pieces may only move along the line through the king and the
+  // pinner.
+  BitBoard pinned_pieces;
+  if (kLegal) {
+    const BitBoard their_knights =
+        their_pieces_ - their_king_ - rooks_ - bishops_ - (pawns_ & kPawnMask);
+    stepper_checkers = (kKnightAttacks[king] & their_knights) |
+                       (kPawnAttacks[king] & their_pieces_ & pawns_);
+    checkers = stepper_checkers |
+               (GetRookAttacks(our_king_, occupied) & their_pieces_ & rooks_) |
+               (GetBishopAttacks(our_king_, occupied) & their_pieces_ &
+                bishops_);
+    if (!checkers.empty()) {
+      const BoardSquare checker = *checkers.begin();
+      if ((checkers - checker).empty()) {
+        check_mask =
+            (Between(our_king_, checker) | checker.as_board()).as_int();
+      } else {
+        check_mask = 0;
       }
-      // Castlings.
-      auto walk_free = [this](int from, int to, int rook, int king) {
-        for (int i = from; i <= to; ++i) {
-          if (i == rook || i == king) continue;
-          if (our_pieces_.get(i) || their_pieces_.get(i)) return false;
+    }
+
+    const BitBoard snipers = (kRookAttacks[king] & their_pieces_ & rooks_) |
+                             (kBishopAttacks[king] & their_pieces_ & bishops_);
+    pinned_pieces = SoleBlockers(our_king_, snipers, occupied) & our_pieces_;
+  }
+  auto pin_allows = [&](BoardSquare source, BoardSquare destination) {
+    return !pinned_pieces.get(source) ||
+           Line(our_king_, source).get(destination);
+  };
+
+  // Destinations of non-pawn moves of the requested kind.
+  const uint64_t empty_targets = ~occupied.as_int() & check_mask;
+  const uint64_t capture_targets = their_pieces_.as_int() & check_mask;
+  const uint64_t targets =
+      (kCaptures ? capture_targets : 0) | (kQuiets ? empty_targets : 0);
+  auto piece_targets = [&](BoardSquare source) {
+    if (!pinned_pieces.get(source)) return targets;
+    return targets & Line(our_king_, source).as_int();
+  };
+
+  // For quiet checks, narrows a piece's destinations to the squares it checks
+  // from, or anywhere off the line it uncovers a check along.
+  const CheckInfo check_info = kChecks ? GenerateCheckInfo() : CheckInfo();
+  auto checking = [&](BoardSquare source, BitBoard direct_checks) -> uint64_t {
+    if (!kChecks) return ~0ULL;
+    if (!check_info.discovered_candidates_.get(source)) {
+      return direct_checks.as_int();
+    }
+    return direct_checks.as_int() | ~Line(their_king_, source).as_int();
+  };
+
+  // Adds the move, or counts it for the piece type @piece.
+  auto add_move = [&](int Mobility::*piece, BoardSquare source,
+                      BoardSquare destination,
+                      Move::Promotion promotion = Move::Promotion::None) {
+    if constexpr (kCount) {
+      ++(moves->*piece);
+    } else {
+      moves->emplace_back(source, destination, promotion);
+    }
+  };
+  auto add_moves = [&](int Mobility::*piece, BoardSquare source,
+                       BitBoard destinations) {
+    if constexpr (kCount) {
+      moves->*piece += destinations.count();
+    } else {
+      AddMoves(source, destinations, moves);
+    }
+  };
+
+  // Non-king moves are all impossible in double check.
+  if (check_mask) {
+    const BitBoard our_pawns = our_pieces_ & pawns_ & kPawnMask;
+    // Without pinned pawns counting needs no look at the single moves.
+    const bool count_pawns = kCount && !pinned_pieces.intersects(our_pawns);
+    // Pawns, all pushes and captures at once.
+    auto add_pawn_moves = [&](uint64_t destinations, int shift) {
+      if constexpr (kCount) {
+        if (count_pawns) {
+          moves->pawns += BitBoard(destinations).count();
+          return;
         }
-        return true;
-      };
-      // @From may be less or greater than @to. @To is not included in check
-      // unless it is the same with @from.
-      auto range_attacked = [this](int from, int to) {
-        if (from == to) return IsUnderAttack(from);
-        const int increment = from < to ? 1 : -1;
-        while (from != to) {
-          if (IsUnderAttack(from)) return true;
-          from += increment;
+      }
+      for (auto destination : BitBoard(destinations)) {
+        const BoardSquare source(destination.as_int() - shift);
+        if (!pin_allows(source, destination)) continue;
+        if (kChecks && !BitBoard(checking(source, check_info.pawn_checks_))
+                            .get(destination)) {
+          continue;
         }
-        return false;
-      };
-      const uint8_t king = source.col();
-      // For castlings we don't check destination king square for checks, it
-      // will be done in legal move check phase.
-      if (castlings_.we_can_000()) {
-        const uint8_t qrook = castlings_.our_queenside_rook();
-        if (walk_free(std::min(static_cast<uint8_t>(C1), qrook),
-                      std::max(static_cast<uint8_t>(D1), king), qrook, king) &&
-            !range_attacked(king, C1)) {
-          result.emplace_back(source, BoardSquare(RANK_1, qrook));
+        add_move(&Mobility::pawns, source, destination);
+      }
+    };
+    // Queen promotions count as captures, the others as quiet moves.
+    auto add_promotions = [&](uint64_t destinations, int shift) {
+      if constexpr (kCount) {
+        if (count_pawns) {
+          moves->pawns += BitBoard(destinations).count() *
+                          ((kCaptures ? 1 : 0) + (kQuiets ? 3 : 0));
+          return;
         }
       }
-      if (castlings_.we_can_00()) {
-        const uint8_t krook = castlings_.our_kingside_rook();
-        if (walk_free(std::min(static_cast<uint8_t>(F1), king),
-                      std::max(static_cast<uint8_t>(G1), krook), krook, king) &&
-            !range_attacked(king, G1)) {
-          result.emplace_back(source, BoardSquare(RANK_1, krook));
+      for (auto destination : BitBoard(destinations)) {
+        const BoardSquare source(destination.as_int() - shift);
+        if (!pin_allows(source, destination)) continue;
+        for (auto promotion : kPromotions) {
+          if (promotion == Move::Promotion::Queen ? !kCaptures : !kQuiets) {
+            continue;
+          }
+          if (kChecks &&
+              !GivesCheck(Move(source, destination, promotion), check_info)) {
+            continue;
+          }
+          add_move(&Mobility::pawns, source, destination, promotion);
         }
       }
-      continue;
-    }
-    bool processed_piece = false;
-    // Rook (and queen)
-    if (rooks_.get(source)) {
-      processed_piece = true;
-      BitBoard attacked =
-          GetRookAttacks(source, our_pieces_ | their_pieces_) - our_pieces_;
-
-      for (const auto& destination : attacked) {
-        result.emplace_back(source, destination);
+    };
+    {
+      const uint64_t pawns = our_pawns.as_int();
+      const uint64_t push = (pawns << 8) & ~occupied.as_int();
+      const uint64_t single_push = push & check_mask;
+      const uint64_t double_push =
+          ((push & kRank3) << 8) & ~occupied.as_int() & check_mask;
+      const uint64_t left_captures = ((pawns & ~kFileA) << 7) & capture_targets;
+      const uint64_t right_captures =
+          ((pawns & ~kFileH) << 9) & capture_targets;
+      if (kQuiets) {
+        add_pawn_moves(single_push & ~kRank8, 8);
+        add_pawn_moves(double_push, 16);
       }
-    }
-    // Bishop (and queen)
-    if (bishops_.get(source)) {
-      processed_piece = true;
-      BitBoard attacked =
-          GetBishopAttacks(source, our_pieces_ | their_pieces_) - our_pieces_;
-
-      for (const auto& destination : attacked) {
-        result.emplace_back(source, destination);
+      if (kCaptures) {
+        add_pawn_moves(left_captures & ~kRank8, 7);
+        add_pawn_moves(right_captures & ~kRank8, 9);
       }
+      add_promotions(single_push & kRank8, 8);
+      add_promotions(left_captures & kRank8, 7);
+      add_promotions(right_captures & kRank8, 9);
     }
-    if (processed_piece) continue;
-    // Pawns.
-    if ((pawns_ & kPawnMask).get(source)) {
-      // Moves forward.
-      {
-        const auto dst_row = source.row() + 1;
-        const auto dst_col = source.col();
-        const BoardSquare destination(dst_row, dst_col);
-
-        if (!our_pieces_.get(destination) && !their_pieces_.get(destination)) {
-          if (dst_row != RANK_8) {
-            result.emplace_back(source, destination);
-            if (dst_row == RANK_3) {
-              // Maybe it'll be possible to move two squares.
-              if (!our_pieces_.get(RANK_4, dst_col) &&
-                  !their_pieces_.get(RANK_4, dst_col)) {
-                result.emplace_back(source, BoardSquare(RANK_4, dst_col));
-              }
-            }
-          } else {
-            // Promotions
-            for (auto promotion : kPromotions) {
-              result.emplace_back(source, destination, promotion);
-            }
-          }
-        }
-      }
-      // Captures.
-      {
-        for (auto direction : {-1, 1}) {
-          const auto dst_row = source.row() + 1;
-          const auto dst_col = source.col() + direction;
-          if (dst_col < 0 || dst_col >= 8) continue;
-          const BoardSquare destination(dst_row, dst_col);
-          if (their_pieces_.get(destination)) {
-            if (dst_row == RANK_8) {
-              // Promotion.
-              for (auto promotion : kPromotions) {
-                result.emplace_back(source, destination, promotion);
-              }
-            } else {
-              // Ordinary capture.
-              result.emplace_back(source, destination);
-            }
-          } else if (dst_row == RANK_6 && pawns_.get(RANK_8, dst_col)) {
-            // En passant.
-            // "Pawn" on opponent's file 8 means that en passant is possible.
-            // Those fake pawns are reset in ApplyMove.
-            result.emplace_back(source, destination);
+
+    // En passant. "Pawn" on opponent's rank 8 marks the capture square's
+    // file. Two pawns leave the fifth rank at once, so legality is verified on
+    // the resulting occupancy instead of using the masks.
+    const uint64_t en_passant = (pawns_ - kPawnMask).as_int() & kRank8;
+    if (kCaptures && en_passant) {
+      const uint64_t destination_bit = en_passant >> 16;
+      const BoardSquare destination(GetLowestBit(destination_bit));
+      const BoardSquare captured(destination.as_int() - 8);
+      const BitBoard capturers =
+          our_pawns & (((destination_bit & ~kFileA) >> 9) |
+                       ((destination_bit & ~kFileH) >> 7));
+      for (auto source : capturers) {
+        if (kLegal) {
+          const BitBoard after =
+              (occupied - source - captured) | destination.as_board();
+          if (!(stepper_checkers - captured).empty() ||
+              GetRookAttacks(our_king_, after)
+                  .intersects(their_pieces_ & rooks_) ||
+              GetBishopAttacks(our_king_, after)
+                  .intersects(their_pieces_ & bishops_)) {
+            continue;
           }
         }
+        add_move(&Mobility::pawns, source, destination);
       }
-      continue;
     }
-    // Knight.
-    {
-      for (const auto destination :
-           kKnightAttacks[source.as_int()] - our_pieces_) {
-        result.emplace_back(source, destination);
+    if constexpr (kAny) {
+      if (moves->total()) return;
+    }
+
+    // Knights. A pinned knight can never move.
+    const BitBoard our_knights =
+        our_pieces_ - our_king_ - rooks_ - bishops_ - our_pawns - pinned_pieces;
+    for (auto source : our_knights) {
+      add_moves(&Mobility::knights, source,
+                kKnightAttacks[source.as_int()] & targets &
+                    checking(source, check_info.knight_checks_));
+    }
+    if constexpr (kAny) {
+      if (moves->total()) return;
+    }
+
+    // Bishops and rooks; queens are in both sets.
+    for (auto source : our_pieces_ & bishops_) {
+      const BitBoard direct_checks =
+          rooks_.get(source)
+              ? check_info.bishop_checks_ | check_info.rook_checks_
+              : check_info.bishop_checks_;
+      add_moves(rooks_.get(source) ? &Mobility::queens : &Mobility::bishops,
+                source,
+                GetBishopAttacks(source, occupied) & piece_targets(source) &
+                    checking(source, direct_checks));
+    }
+    for (auto source : our_pieces_ & rooks_) {
+      const BitBoard direct_checks =
+          bishops_.get(source)
+              ? check_info.bishop_checks_ | check_info.rook_checks_
+              : check_info.rook_checks_;
+      add_moves(bishops_.get(source) ? &Mobility::queens : &Mobility::rooks,
+                source,
+                GetRookAttacks(source, occupied) & piece_targets(source) &
+                    checking(source, direct_checks));
+    }
+    if constexpr (kAny) {
+      if (moves->total()) return;
+    }
+  }
+
+  // King. For legal moves the king itself must not block attacks along the
+  // line it steps on. It can only give check by discovery. The attacked
+  // squares are computed once for the king moves and the castlings.
+  const BitBoard attacked =
+      TheirAttacks(kLegal ? occupied - our_king_ : occupied);
+  const uint64_t king_targets =
+      (kCaptures ? their_pieces_.as_int() : 0) |
+      (kQuiets ? ~occupied.as_int() : 0);
+  add_moves(&Mobility::king, our_king_,
+            (kKingAttacks[king] & king_targets & checking(our_king_, 0)) -
+                attacked);
+
+  // Castlings. The squares both pieces travel over, apart from the pieces
+  // themselves, must be empty, and the squares the king leaves and passes
+  // must not be attacked. Pseudolegal generation leaves the king's destination
+  // to the legality check; the legal one tests it with both pieces already
+  // moved, as the castling rook may have been shielding it.
+  if (!kQuiets || (kLegal && !checkers.empty())) return;
+  auto add_castling = [&](uint8_t rook, uint8_t king_dst, uint8_t rook_dst) {
+    const BitBoard path =
+        FirstRankSpan(std::min({king, rook, king_dst, rook_dst}),
+                      std::max({king, rook, king_dst, rook_dst}));
+    if (path.intersects(occupied - our_king_ - BoardSquare(rook))) return;
+    const uint64_t king_path =
+        king == king_dst ? 1ULL << king
+                         : FirstRankSpan(king, king_dst) & ~(1ULL << king_dst);
+    if (attacked.intersects(king_path)) return;
+    const BitBoard after = (occupied - our_king_ - BoardSquare(rook)) |
+                           BoardSquare(rook_dst).as_board();
+    if (kLegal && IsUnderAttack(king_dst, after)) return;
+    // Only the rook can check, directly or by moving off a bishop's line.
+    if (kChecks) {
+      const BitBoard our_rooks = ((our_pieces_ & rooks_) - BoardSquare(rook)) |
+                                 BoardSquare(rook_dst).as_board();
+      const BitBoard after_king = after | BoardSquare(king_dst).as_board();
+      if (!GetRookAttacks(their_king_, after_king).intersects(our_rooks) &&
+          !GetBishopAttacks(their_king_, after_king)
+               .intersects(our_pieces_ & bishops_)) {
+        return;
       }
     }
+    add_move(&Mobility::king, our_king_, BoardSquare(RANK_1, rook));
+  };
+  if (castlings_.we_can_000()) {
+    add_castling(castlings_.our_queenside_rook(), C1, D1);
+  }
+  if (castlings_.we_can_00()) {
+    add_castling(castlings_.our_kingside_rook(), G1, F1);
   }
+}
+
+MoveList ChessBoard::GeneratePseudolegalMoves() const {
+  MoveList result;
+  GenerateMoves<GenType::kPseudolegal>(&result);
   return result;
-}  // namespace lczero
+}
 
 bool ChessBoard::ApplyMove(Move move) {
+  // Only the squares the move can change are rehashed, before and after.
+  const auto from = move.from();
+  const auto to = move.to();
+  BitBoard touched = from.as_board() | to.as_board();
+  if (from == our_king_) {
+    if (to.row() == RANK_1 &&
+        (our_pieces_.get(to) || std::abs(to.col() - from.col()) > 1)) {
+      touched = touched | kCastlingSquares;
+    }
+  } else if (from.row() == RANK_5 && from.col() != to.col() &&
+             pawns_.get(RANK_8, to.col())) {
+    touched.set(RANK_5, to.col());
+  }
+  const auto castlings = castlings_.as_int();
+  const auto en_passant = pawns_ - kPawnMask;
+  HashSquares(touched, &key_, &pawn_key_);
+  const bool reset_50_moves = ApplyMoveUnhashed(move);
+  HashSquares(touched, &key_, &pawn_key_);
+  if (castlings != castlings_.as_int()) {
+    key_ ^= CastlingsKey(castlings) ^ CastlingsKey(castlings_.as_int());
+  }
+  for (auto flag : BitBoard(en_passant.as_int() ^
+                             (pawns_ - kPawnMask).as_int())) {
+    key_ ^= kZobrist.en_passant[flag.col()];
+  }
+  assert(key_ == ComputeHash());
+  assert(pawn_key_ == ComputePawnHash());
+  return reset_50_moves;
+}
+
+bool ChessBoard::ApplyMoveUnhashed(Move move) {
   const auto& from = move.from();
   const auto& to = move.to();
   const auto from_row = from.row();
@@ -696,7 +1259,96 @@ bool ChessBoard::ApplyMove(Move move) {
   return reset_50_moves;
 }
 
+bool ChessBoard::DoMove(Move move, UndoInfo* undo) {
+  const auto from = move.from();
+  const auto to = move.to();
+  const BitBoard pawns = pawns_ & kPawnMask;
+  undo->key = key_;
+  undo->pawn_key = pawn_key_;
+  undo->en_passant = pawns_ - kPawnMask;
+  undo->castlings = castlings_;
+
+  // Same castling detection as ApplyMove().
+  undo->castling = false;
+  if (from == our_king_ && from.row() == RANK_1 && to.row() == RANK_1) {
+    if ((rooks() & our_pieces_).get(to)) {
+      undo->castling = true;
+      undo->castling_rook = to;
+    } else if (from.col() == FILE_E && to.col() == FILE_G) {
+      undo->castling = true;
+      undo->castling_rook = H1;
+    } else if (from.col() == FILE_E && to.col() == FILE_C) {
+      undo->castling = true;
+      undo->castling_rook = A1;
+    }
+  }
+  undo->promotion = pawns.get(from) && to.row() == RANK_8;
+
+  undo->captured_square = to;
+  if (!their_pieces_.get(to) && from.row() == RANK_5 && pawns.get(from) &&
+      from.col() != to.col() && pawns_.get(RANK_8, to.col())) {
+    undo->captured_square = BoardSquare(RANK_5, to.col());
+  }
+  const auto captured = undo->captured_square;
+  undo->captured = their_pieces_.get(captured);
+  undo->captured_rook = rooks_.get(captured);
+  undo->captured_bishop = bishops_.get(captured);
+  undo->captured_pawn = pawns.get(captured);
+
+  return ApplyMove(move);
+}
+
+void ChessBoard::UndoMove(Move move, const UndoInfo& undo) {
+  const auto from = move.from();
+  const auto to = move.to();
+  if (undo.castling) {
+    // Clear both destinations first, either may be a source in FRC.
+    const bool kingside = to.col() > from.col();
+    const BoardSquare king_dst(kingside ? G1 : C1);
+    const BoardSquare rook_dst(kingside ? F1 : D1);
+    our_pieces_.reset(king_dst);
+    our_pieces_.reset(rook_dst);
+    rooks_.reset(rook_dst);
+    our_pieces_.set(from);
+    our_pieces_.set(undo.castling_rook);
+    rooks_.set(undo.castling_rook);
+    our_king_ = from;
+  } else {
+    our_pieces_.reset(to);
+    our_pieces_.set(from);
+    if (undo.promotion) {
+      pawns_.set(from);
+    } else {
+      rooks_.set_if(from, rooks_.get(to));
+      bishops_.set_if(from, bishops_.get(to));
+      pawns_.set_if(from, pawns_.get(to));
+    }
+    rooks_.reset(to);
+    bishops_.reset(to);
+    pawns_.reset(to);
+    if (our_king_ == to) our_king_ = from;
+
+    const auto captured = undo.captured_square;
+    if (undo.captured) {
+      their_pieces_.set(captured);
+      rooks_.set_if(captured, undo.captured_rook);
+      bishops_.set_if(captured, undo.captured_bishop);
+      pawns_.set_if(captured, undo.captured_pawn);
+    }
+  }
+
+  pawns_ = (pawns_ & kPawnMask) | undo.en_passant;
+  castlings_ = undo.castlings;
+  key_ = undo.key;
+  pawn_key_ = undo.pawn_key;
+}
+
 bool ChessBoard::IsUnderAttack(BoardSquare square) const {
+  return IsUnderAttack(square, our_pieces_ | their_pieces_);
+}
+
+bool ChessBoard::IsUnderAttack(BoardSquare square,
+                               const BitBoard occupied) const {
   const int row = square.row();
   const int col = square.col();
   // Check king.
@@ -706,13 +1358,11 @@ bool ChessBoard::IsUnderAttack(BoardSquare square) const {
     if (std::abs(krow - row) <= 1 && std::abs(kcol - col) <= 1) return true;
   }
   // Check rooks (and queens).
-  if (GetRookAttacks(square, our_pieces_ | their_pieces_)
-          .intersects(their_pieces_ & rooks_)) {
+  if (GetRookAttacks(square, occupied).intersects(their_pieces_ & rooks_)) {
     return true;
   }
   // Check bishops.
-  if (GetBishopAttacks(square, our_pieces_ | their_pieces_)
-          .intersects(their_pieces_ & bishops_)) {
+  if (GetBishopAttacks(square, occupied).intersects(their_pieces_ & bishops_)) {
     return true;
   }
   // Check pawns.
@@ -730,6 +1380,154 @@ bool ChessBoard::IsUnderAttack(BoardSquare square) const {
   return false;
 }
 
+BitBoard ChessBoard::AttackersTo(const BoardSquare square,
+                                  const BitBoard occupied) const {
+  const BitBoard pawns = pawns_ & kPawnMask;
+  const BitBoard kings = our_king_.as_board() | their_king_.as_board();
+  const BitBoard knights =
+      (our_pieces_ | their_pieces_) - pawns - rooks_ - bishops_ - kings;
+  return (kOurPawnAttacks[square.as_int()] & our_pieces_ & pawns) |
+         (kPawnAttacks[square.as_int()] & their_pieces_ & pawns) |
+         (kKnightAttacks[square.as_int()] & knights) |
+         (kKingAttacks[square.as_int()] & kings) |
+         (GetRookAttacks(square, occupied) & rooks_) |
+         (GetBishopAttacks(square, occupied) & bishops_);
+}
+
+int ChessBoard::SEEValue(const BoardSquare square) const {
+  if (!our_pieces_.get(square) && !their_pieces_.get(square)) return 0;
+  if (square == our_king_ || square == their_king_) return kSEEKingValue;
+  if ((pawns_ & kPawnMask).get(square)) return kSEEPawnValue;
+  if (rooks_.get(square)) {
+    return bishops_.get(square) ? kSEEQueenValue : kSEERookValue;
+  }
+  return bishops_.get(square) ? kSEEBishopValue : kSEEKnightValue;
+}
+
+int ChessBoard::LeastValuableAttacker(const BitBoard attackers,
+                                      BoardSquare* square) const {
+  const BitBoard pawns = pawns_ & kPawnMask;
+  const BitBoard kings = our_king_.as_board() | their_king_.as_board();
+  const std::pair<BitBoard, int> pieces[] = {
+      {attackers & pawns, kSEEPawnValue},
+      {attackers - pawns - rooks_ - bishops_ - kings, kSEEKnightValue},
+      {attackers & (bishops_ - rooks_), kSEEBishopValue},
+      {attackers & (rooks_ - bishops_), kSEERookValue},
+      {attackers & rooks_ & bishops_, kSEEQueenValue},
+  };
+  for (const auto& [board, value] : pieces) {
+    if (board.empty()) continue;
+    *square = *board.begin();
+    return value;
+  }
+  *square = *(attackers & kings).begin();
+  return kSEEKingValue;
+}
+
+int ChessBoard::SEECapture(const Move move, int* piece_value,
+                           BitBoard* occupied) const {
+  const BoardSquare from = move.from();
+  const BoardSquare to = move.to();
+  *occupied = ((our_pieces_ | their_pieces_) - from) | to.as_board();
+  *piece_value = SEEValue(from);
+  int captured = SEEValue(to);
+  if (*piece_value == kSEEPawnValue && from.col() != to.col() && !captured) {
+    // En passant.
+    captured = kSEEPawnValue;
+    *occupied = *occupied - BoardSquare(to.row() - 1, to.col());
+  }
+  switch (move.promotion()) {
+    case Move::Promotion::Queen:
+      *piece_value = kSEEQueenValue;
+      break;
+    case Move::Promotion::Rook:
+      *piece_value = kSEERookValue;
+      break;
+    case Move::Promotion::Bishop:
+      *piece_value = kSEEBishopValue;
+      break;
+    case Move::Promotion::Knight:
+      *piece_value = kSEEKnightValue;
+      break;
+    case Move::Promotion::None:
+      return captured;
+  }
+  return captured + *piece_value - kSEEPawnValue;
+}
+
+int ChessBoard::SEE(const Move move) const {
+  // Castling, encoded as the king capturing its rook, exchanges nothing.
+  if (our_pieces_.get(move.to())) return 0;
+  const BoardSquare to = move.to();
+  int piece_value;
+  BitBoard occupied;
+  // gain[i] is what the side making the i-th capture has won, if the other
+  // side then stops.
+  int gain[32];
+  gain[0] = SEECapture(move, &piece_value, &occupied);
+  BitBoard attackers = AttackersTo(to, occupied) & occupied;
+  bool their_turn = true;
+  int depth = 0;
+  while (depth < 31) {
+    const BitBoard side =
+        attackers & (their_turn ? their_pieces_ : our_pieces_);
+    if (side.empty()) break;
+    BoardSquare square;
+    const int value = LeastValuableAttacker(side, &square);
+    gain[depth + 1] = piece_value - gain[depth];
+    depth++;
+    piece_value = value;
+    occupied = occupied - square;
+    // Sliders behind the capturing piece join in.
+    attackers = (attackers | (GetRookAttacks(to, occupied) & rooks_) |
+                 (GetBishopAttacks(to, occupied) & bishops_)) &
+                occupied;
+    their_turn = !their_turn;
+  }
+  // Each side recaptures only when that beats stopping the exchange.
+  for (; depth > 0; depth--) {
+    gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+  }
+  return gain[0];
+}
+
+bool ChessBoard::SEEGreaterOrEqual(const Move move, const int threshold) const {
+  if (our_pieces_.get(move.to())) return threshold <= 0;
+  const BoardSquare to = move.to();
+  int piece_value;
+  BitBoard occupied;
+  // How far the exchange is from the threshold, with the piece on the
+  // destination captured.
+  int swap = SEECapture(move, &piece_value, &occupied) - threshold;
+  if (swap < 0) return false;
+  swap = piece_value - swap;
+  if (swap <= 0) return true;
+  BitBoard attackers = AttackersTo(to, occupied) & occupied;
+  bool their_turn = true;
+  // Whether the threshold is met if the exchange stops here.
+  bool result = true;
+  while (true) {
+    const BitBoard side =
+        attackers & (their_turn ? their_pieces_ : our_pieces_);
+    if (side.empty()) break;
+    result = !result;
+    BoardSquare square;
+    const int value = LeastValuableAttacker(side, &square);
+    if (value == kSEEKingValue) {
+      // The king can only capture when no piece recaptures.
+      return (attackers - side).empty() ? result : !result;
+    }
+    swap = value - swap;
+    if (swap < static_cast<int>(result)) break;
+    occupied = occupied - square;
+    attackers = (attackers | (GetRookAttacks(to, occupied) & rooks_) |
+                 (GetBishopAttacks(to, occupied) & bishops_)) &
+                occupied;
+    their_turn = !their_turn;
+  }
+  return result;
+}
+
 bool ChessBoard::IsSameMove(Move move1, Move move2) const {
   // If moves are equal, it's the same move.
   if (move1 == move2) return true;
@@ -768,95 +1566,26 @@ KingAttackInfo ChessBoard::GenerateKingAttackInfo() const {
   // Number of attackers that give check (used for double check detection).
   unsigned num_king_attackers = 0;
 
-  const int row = our_king_.row();
-  const int col = our_king_.col();
+  const BitBoard occupied = our_pieces_ | their_pieces_;
+  const uint8_t king = our_king_.as_int();
   // King checks are unnecessary, as kings cannot give check.
-  // Check rooks (and queens).
-  if (kRookAttacks[our_king_.as_int()].intersects(their_pieces_ & rooks_)) {
-    for (const auto& direction : kRookDirections) {
-      auto dst_row = row;
-      auto dst_col = col;
-      BitBoard attack_line(0);
-      bool possible_pinned_piece_found = false;
-      BoardSquare possible_pinned_piece;
-      while (true) {
-        dst_row += direction.first;
-        dst_col += direction.second;
-        if (!BoardSquare::IsValid(dst_row, dst_col)) break;
-        const BoardSquare destination(dst_row, dst_col);
-        if (our_pieces_.get(destination)) {
-          if (possible_pinned_piece_found) {
-            // No pieces pinned.
-            break;
-          } else {
-            // This is a possible pinned piece.
-            possible_pinned_piece_found = true;
-            possible_pinned_piece = destination;
-          }
-        }
-        if (!possible_pinned_piece_found) {
-          attack_line.set(destination);
-        }
-        if (their_pieces_.get(destination)) {
-          if (rooks_.get(destination)) {
-            if (possible_pinned_piece_found) {
-              // Store the pinned piece.
-              king_attack_info.pinned_pieces_.set(possible_pinned_piece);
-            } else {
-              // Update attack lines.
-              king_attack_info.attack_lines_ =
-                  king_attack_info.attack_lines_ | attack_line;
-              num_king_attackers++;
-            }
-          }
-          break;
-        }
-      }
-    }
-  }
-  // Check bishops.
-  if (kBishopAttacks[our_king_.as_int()].intersects(their_pieces_ & bishops_)) {
-    for (const auto& direction : kBishopDirections) {
-      auto dst_row = row;
-      auto dst_col = col;
-      BitBoard attack_line(0);
-      bool possible_pinned_piece_found = false;
-      BoardSquare possible_pinned_piece;
-      while (true) {
-        dst_row += direction.first;
-        dst_col += direction.second;
-        if (!BoardSquare::IsValid(dst_row, dst_col)) break;
-        const BoardSquare destination(dst_row, dst_col);
-        if (our_pieces_.get(destination)) {
-          if (possible_pinned_piece_found) {
-            // No pieces pinned.
-            break;
-          } else {
-            // This is a possible pinned piece.
-            possible_pinned_piece_found = true;
-            possible_pinned_piece = destination;
-          }
-        }
-        if (!possible_pinned_piece_found) {
-          attack_line.set(destination);
-        }
-        if (their_pieces_.get(destination)) {
-          if (bishops_.get(destination)) {
-            if (possible_pinned_piece_found) {
-              // Store the pinned piece.
-              king_attack_info.pinned_pieces_.set(possible_pinned_piece);
-            } else {
-              // Update attack lines.
-              king_attack_info.attack_lines_ =
-                  king_attack_info.attack_lines_ | attack_line;
-              num_king_attackers++;
-            }
-          }
-          break;
-        }
-      }
-    }
+  // Check rooks, bishops and queens. The attack line of a slider runs from the
+  // king to the slider, both included.
+  const BitBoard slider_checkers =
+      (GetRookAttacks(our_king_, occupied) & their_pieces_ & rooks_) |
+      (GetBishopAttacks(our_king_, occupied) & their_pieces_ & bishops_);
+  for (auto checker : slider_checkers) {
+    king_attack_info.attack_lines_ = king_attack_info.attack_lines_ |
+                                     Between(our_king_, checker) |
+                                     checker.as_board();
+    num_king_attackers++;
   }
+  // Our only pieces between the king and one of their sliders are pinned.
+  const BitBoard snipers = (kRookAttacks[king] & their_pieces_ & rooks_) |
+                           (kBishopAttacks[king] & their_pieces_ & bishops_);
+  king_attack_info.pinned_pieces_ =
+      SoleBlockers(our_king_, snipers, occupied) & our_pieces_;
+
   // Check pawns.
   const BitBoard attacking_pawns =
       kPawnAttacks[our_king_.as_int()] & their_pieces_ & pawns_;
@@ -947,25 +1676,205 @@ bool ChessBoard::IsLegalMove(Move move,
 
   // The piece is pinned. Now check that it stays on the same line w.r.t. the
   // king.
-  const int dx_from = from.col() - our_king_.col();
-  const int dy_from = from.row() - our_king_.row();
-  const int dx_to = to.col() - our_king_.col();
-  const int dy_to = to.row() - our_king_.row();
+  return Line(our_king_, from).get(to);
+}
 
-  if (dx_from == 0 || dx_to == 0) {
-    return (dx_from == dx_to);
-  } else {
-    return (dx_from * dy_to == dx_to * dy_from);
+bool ChessBoard::IsPseudoLegal(Move move) const {
+  const BoardSquare from = move.from();
+  const BoardSquare to = move.to();
+  if (!our_pieces_.get(from)) return false;
+  const BitBoard occupied = our_pieces_ | their_pieces_;
+  const bool promotion = move.promotion() != Move::Promotion::None;
+
+  if ((pawns_ & kPawnMask).get(from)) {
+    // Pawns promote exactly when reaching the last rank.
+    if (promotion != (to.row() == RANK_8)) return false;
+    if (to.col() == from.col()) {
+      if (occupied.get(to)) return false;
+      if (to.row() == from.row() + 1) return true;
+      return from.row() == RANK_2 && to.row() == RANK_4 &&
+             !occupied.get(BoardSquare(RANK_3, from.col()));
+    }
+    if (to.row() != from.row() + 1 || std::abs(to.col() - from.col()) != 1) {
+      return false;
+    }
+    if (their_pieces_.get(to)) return true;
+    // En passant, flagged by a "pawn" on their first rank.
+    return to.row() == RANK_6 && pawns_.get(RANK_8, to.col());
+  }
+  if (promotion) return false;
+
+  if (from == our_king_) {
+    if (our_pieces_.get(to)) {
+      // Castling, encoded as the king capturing its rook. Same conditions as
+      // in GenerateMoves().
+      if (to.row() != RANK_1) return false;
+      const uint8_t king = from.as_int();
+      const uint8_t rook = to.as_int();
+      uint8_t king_dst;
+      uint8_t rook_dst;
+      if (castlings_.we_can_000() && rook == castlings_.our_queenside_rook()) {
+        king_dst = C1;
+        rook_dst = D1;
+      } else if (castlings_.we_can_00() &&
+                 rook == castlings_.our_kingside_rook()) {
+        king_dst = G1;
+        rook_dst = F1;
+      } else {
+        return false;
+      }
+      const BitBoard path =
+          FirstRankSpan(std::min({king, rook, king_dst, rook_dst}),
+                        std::max({king, rook, king_dst, rook_dst}));
+      if (path.intersects(occupied - from - to)) return false;
+      const uint64_t king_path =
+          king == king_dst
+              ? 1ULL << king
+              : FirstRankSpan(king, king_dst) & ~(1ULL << king_dst);
+      return !TheirAttacks(occupied).intersects(king_path);
+    }
+    return kKingAttacks[from.as_int()].get(to) && !IsUnderAttack(to);
+  }
+  if (our_pieces_.get(to)) return false;
+
+  if (bishops_.get(from) && GetBishopAttacks(from, occupied).get(to)) {
+    return true;
+  }
+  if (rooks_.get(from) && GetRookAttacks(from, occupied).get(to)) {
+    return true;
   }
+  return !bishops_.get(from) && !rooks_.get(from) &&
+         kKnightAttacks[from.as_int()].get(to);
+}
+
+bool ChessBoard::IsLegal(Move move) const {
+  if (!IsPseudoLegal(move)) return false;
+  const BoardSquare from = move.from();
+  const BoardSquare to = move.to();
+  const BitBoard occupied = our_pieces_ | their_pieces_;
+
+  if (from == our_king_) {
+    if (our_pieces_.get(to)) {
+      // Castling. The path was checked already, but the rook may have been
+      // shielding the king's destination.
+      const bool queenside = to.col() < from.col();
+      const BitBoard after =
+          (occupied - from - to) | BoardSquare(queenside ? D1 : F1).as_board();
+      return (AttackersTo(BoardSquare(queenside ? C1 : G1), after) &
+              their_pieces_)
+          .empty();
+    }
+    // The king must not stay on the line of a slider it moves away from.
+    return ((AttackersTo(to, occupied - from) & their_pieces_) - to).empty();
+  }
+
+  BoardSquare captured = to;
+  if (!their_pieces_.get(to) && from.col() != to.col() &&
+      (pawns_ & kPawnMask).get(from)) {
+    captured = BoardSquare(RANK_5, to.col());
+  }
+  const BitBoard after = (occupied - from - captured) | to.as_board();
+  return ((AttackersTo(our_king_, after) & their_pieces_) - captured).empty();
+}
+
+bool ChessBoard::GivesCheck(Move move, const CheckInfo& check_info) const {
+  const BoardSquare from = move.from();
+  const BoardSquare to = move.to();
+  const BitBoard occupied = our_pieces_ | their_pieces_;
+  // Whether one of @our_rooks or our bishops attacks their king through
+  // @after.
+  auto slider_checks = [&](BitBoard after, BitBoard our_rooks) {
+    return GetRookAttacks(their_king_, after).intersects(our_rooks) ||
+           GetBishopAttacks(their_king_, after)
+               .intersects(our_pieces_ & bishops_);
+  };
+
+  if (from == our_king_ && our_pieces_.get(to)) {
+    // Castling. Only the rook can check, directly or by moving off a line.
+    const bool queenside = to.col() < from.col();
+    const BoardSquare rook_dst(queenside ? D1 : F1);
+    const BitBoard after = (occupied - from - to) | rook_dst.as_board() |
+                           BoardSquare(queenside ? C1 : G1).as_board();
+    return slider_checks(after,
+                         ((our_pieces_ & rooks_) - to) | rook_dst.as_board());
+  }
+  // Discovered check: the piece leaves the line between their king and one of
+  // our sliders.
+  if (check_info.discovered_candidates_.get(from) &&
+      !Line(their_king_, from).get(to)) {
+    return true;
+  }
+  if (from == our_king_) return false;
+
+  if ((pawns_ & kPawnMask).get(from)) {
+    const BitBoard after = (occupied - from) | to.as_board();
+    switch (move.promotion()) {
+      case Move::Promotion::Knight:
+        return kKnightAttacks[to.as_int()].get(their_king_);
+      case Move::Promotion::Bishop:
+        return GetBishopAttacks(to, after).get(their_king_);
+      case Move::Promotion::Rook:
+        return GetRookAttacks(to, after).get(their_king_);
+      case Move::Promotion::Queen:
+        return GetBishopAttacks(to, after).get(their_king_) ||
+               GetRookAttacks(to, after).get(their_king_);
+      default:
+        break;
+    }
+    if (check_info.pawn_checks_.get(to)) return true;
+    // En passant also uncovers lines through the captured pawn.
+    if (from.col() == to.col() || their_pieces_.get(to)) return false;
+    return slider_checks(after - BoardSquare(RANK_5, to.col()),
+                         our_pieces_ & rooks_);
+  }
+  if (bishops_.get(from) && check_info.bishop_checks_.get(to)) return true;
+  if (rooks_.get(from) && check_info.rook_checks_.get(to)) return true;
+  return !bishops_.get(from) && !rooks_.get(from) &&
+         check_info.knight_checks_.get(to);
 }
 
 MoveList ChessBoard::GenerateLegalMoves() const {
-  const KingAttackInfo king_attack_info = GenerateKingAttackInfo();
-  MoveList result = GeneratePseudolegalMoves();
-  result.erase(
-      std::remove_if(result.begin(), result.end(),
-                     [&](Move m) { return !IsLegalMove(m, king_attack_info); }),
-      result.end());
+  MoveList result;
+  GenerateMoves<GenType::kLegal>(&result);
+  return result;
+}
+
+int ChessBoard::CountLegalMoves() const { return GetMobility().total(); }
+
+bool ChessBoard::HasAnyLegalMove() const {
+  Mobility mobility;
+  GenerateMoves<GenType::kAnyLegal>(&mobility);
+  return mobility.total() > 0;
+}
+
+Mobility ChessBoard::GetMobility() const {
+  Mobility mobility;
+  GenerateMoves<GenType::kLegal>(&mobility);
+  return mobility;
+}
+
+MoveList ChessBoard::GenerateCaptures() const {
+  MoveList result;
+  GenerateMoves<GenType::kCaptures>(&result);
+  return result;
+}
+
+MoveList ChessBoard::GenerateQuiets() const {
+  MoveList result;
+  GenerateMoves<GenType::kQuiets>(&result);
+  return result;
+}
+
+MoveList ChessBoard::GenerateEvasions() const {
+  assert(IsUnderCheck());
+  MoveList result;
+  GenerateMoves<GenType::kEvasions>(&result);
+  return result;
+}
+
+MoveList ChessBoard::GenerateQuietChecks() const {
+  MoveList result;
+  GenerateMoves<GenType::kQuietChecks>(&result);
   return result;
 }
 
@@ -1114,6 +2023,8 @@ void ChessBoard::SetFromFen(std::string fen, int* rule50_ply, int* moves) {
     pawns_.set((square.row() == RANK_3) ? RANK_1 : RANK_8, square.col());
   }
 
+  key_ = ComputeHash();
+  pawn_key_ = ComputePawnHash();
   if (who_to_move == "b" || who_to_move == "B") {
     Mirror();
   } else if (who_to_move != "w" && who_to_move != "W") {
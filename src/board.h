@@ -35,8 +35,31 @@
 
 namespace lczero {
 
-// Initializes internal magic bitboard structures.
-void InitializeMagicBitboards();
+// How rook and bishop attacks are looked up. The best backend for the CPU is
+// picked at startup.
+enum class SliderBackend : uint8_t {
+  // Bit scans along the rays. Runs anywhere, before static initialization too.
+  kPortable,
+  // Magic bitboards.
+  kMagic,
+  // pext into the attacks tables, on CPUs with fast BMI2.
+  kPext,
+};
+
+// Returns whether this build and CPU can run @backend.
+bool IsSliderBackendSupported(SliderBackend backend);
+SliderBackend GetSliderBackend();
+// Switches the backend of all boards, e.g. to compare them. Throws if
+// unsupported.
+void SetSliderBackend(SliderBackend backend);
+const char* SliderBackendName(SliderBackend backend);
+// Describes the slider and popcount backends in use and the CPU features they
+// were picked for, for "info string".
+std::string BackendsDebugString();
+// Squares a rook or a bishop on @square attacks with @occupied pieces on the
+// board, looked up with the backend in use.
+BitBoard RookAttacks(BoardSquare square, BitBoard occupied);
+BitBoard BishopAttacks(BoardSquare square, BitBoard occupied);
 
 // Represents king attack info used during legal move detection.
 class KingAttackInfo {
@@ -55,6 +78,47 @@ class KingAttackInfo {
   BitBoard attack_lines_ = {0};
 };
 
+// Represents the squares "our" (white) pieces give check to "their" (black)
+// king from, used to generate checking moves.
+class CheckInfo {
+ public:
+  BitBoard pawn_checks_ = {0};
+  BitBoard knight_checks_ = {0};
+  BitBoard bishop_checks_ = {0};
+  BitBoard rook_checks_ = {0};
+  // Our pieces which are the only blocker between our slider and their king.
+  BitBoard discovered_candidates_ = {0};
+};
+
+// Numbers of legal moves of "our" (white) pieces, by piece type.
+struct Mobility {
+  int pawns = 0;
+  int knights = 0;
+  int bishops = 0;
+  int rooks = 0;
+  int queens = 0;
+  int king = 0;
+
+  int total() const {
+    return pawns + knights + bishops + rooks + queens + king;
+  }
+};
+
+// Squares attacked by "their" (black) pieces, by piece type, with "our"
+// (white) king taken off the board.
+struct AttackMap {
+  BitBoard pawns;
+  BitBoard knights;
+  BitBoard bishops;
+  BitBoard rooks;
+  BitBoard queens;
+  BitBoard king;
+
+  BitBoard all() const {
+    return pawns | knights | bishops | rooks | queens | king;
+  }
+};
+
 // Represents a board position.
 // Unlike most chess engines, the board is mirrored for black.
 class ChessBoard {
@@ -91,13 +155,54 @@ class ChessBoard {
   KingAttackInfo GenerateKingAttackInfo() const;
   // Checks if "our" (white) king is under check.
   bool IsUnderCheck() const { return IsUnderAttack(our_king_); }
+  // Returns all squares attacked by "their" (black) pieces, with "our" (white)
+  // king taken off the board so that the squares behind it on a slider's line
+  // count as attacked, i.e. the squares our king must not step on.
+  BitBoard TheirAttacks() const;
+  // Same squares as TheirAttacks(), by attacking piece type.
+  AttackMap GetAttackMap() const;
 
   // Checks whether at least one of the sides has mating material.
   bool HasMatingMaterial() const;
-  // Generates legal moves.
+  // Generates legal moves directly, from the checkers and pinned pieces of
+  // the position, without testing each pseudolegal move. The moves come in the
+  // same order as from GeneratePseudolegalMoves().
   MoveList GenerateLegalMoves() const;
+  // Counts the moves GenerateLegalMoves() generates, from the popcounts of
+  // their destination masks, without building the list.
+  int CountLegalMoves() const;
+  // Returns whether there is a legal move. Looks at the king's moves, the
+  // costliest to generate, last.
+  bool HasAnyLegalMove() const;
+  // Counts the legal moves of each of "our" (white) piece types.
+  Mobility GetMobility() const;
+  // Generates legal captures, en passant and queen promotions included.
+  MoveList GenerateCaptures() const;
+  // Generates the legal moves GenerateCaptures() leaves out: non-captures,
+  // castlings and underpromotions.
+  MoveList GenerateQuiets() const;
+  // Generates legal moves when "our" (white) king is under check.
+  MoveList GenerateEvasions() const;
+  // Generates the moves of GenerateQuiets() which give check.
+  MoveList GenerateQuietChecks() const;
+  // Generates the check info used for quiet check generation.
+  CheckInfo GenerateCheckInfo() const;
   // Check whether pseudolegal move is legal.
   bool IsLegalMove(Move move, const KingAttackInfo& king_attack_info) const;
+  // Returns whether @move, e.g. from a hash table or another position, is one
+  // GeneratePseudolegalMoves() would generate, without generating them.
+  // Castling has to be encoded in the modern way.
+  bool IsPseudoLegal(Move move) const;
+  // Returns whether @move is one GenerateLegalMoves() would generate.
+  bool IsLegal(Move move) const;
+  // Returns whether legal @move checks "their" (black) king, directly or by
+  // discovery, without applying it. Castling has to be encoded in the modern
+  // way.
+  bool GivesCheck(Move move) const {
+    return GivesCheck(move, GenerateCheckInfo());
+  }
+  // Same, with the check info of the position computed once for all moves.
+  bool GivesCheck(Move move, const CheckInfo& check_info) const;
   // Returns whether two moves are actually the same move in the position.
   bool IsSameMove(Move move1, Move move2) const;
   // Returns the same move but with castling encoded in legacy way.
@@ -105,14 +210,24 @@ class ChessBoard {
   // Returns the same move but with castling encoded in modern way.
   Move GetModernMove(Move move) const;
 
-  uint64_t Hash() const {
-    return HashCat({our_pieces_.as_int(), their_pieces_.as_int(),
-                    rooks_.as_int(), bishops_.as_int(), pawns_.as_int(),
-                    (static_cast<uint32_t>(our_king_.as_int()) << 24) |
-                        (static_cast<uint32_t>(their_king_.as_int()) << 16) |
-                        (static_cast<uint32_t>(castlings_.as_int()) << 8) |
-                        static_cast<uint32_t>(flipped_)});
-  }
+  // Static exchange evaluation: the material "we" (white) win with @move once
+  // both sides recapture on its destination with their least valuable piece,
+  // x-rays through sliders included, as long as that pays off. Pins are
+  // ignored. Values are centipawns: pawn 100, knight and bishop 300, rook 500
+  // and queen 900.
+  int SEE(Move move) const;
+  // Returns whether SEE(move) >= threshold, stopping the exchange as soon as
+  // that is decided.
+  bool SEEGreaterOrEqual(Move move, int threshold) const;
+
+  // Zobrist key of the position, kept up to date by ApplyMove() and Mirror().
+  // The same position gets the same key whichever side is "ours".
+  uint64_t Hash() const { return key_; }
+  // Zobrist key of the pawns of both sides only.
+  uint64_t PawnHash() const { return pawn_key_; }
+  // Recompute the keys from scratch, to verify the incremental ones.
+  uint64_t ComputeHash() const;
+  uint64_t ComputePawnHash() const;
 
   class Castlings {
    public:
@@ -219,6 +334,31 @@ class ChessBoard {
     uint8_t data_;
   };
 
+  // What UndoMove() needs to take back a move and can't tell from the move
+  // itself.
+  struct UndoInfo {
+    uint64_t key;
+    uint64_t pawn_key;
+    BitBoard en_passant;
+    Castlings castlings;
+    // Square of the captured piece, which is not the move's destination for
+    // en passant.
+    BoardSquare captured_square;
+    bool captured;
+    bool captured_rook;
+    bool captured_bishop;
+    bool captured_pawn;
+    bool promotion;
+    bool castling;
+    BoardSquare castling_rook;
+  };
+
+  // Same as ApplyMove(), and saves into @undo what UndoMove() needs.
+  bool DoMove(Move move, UndoInfo* undo);
+  // Takes back @move applied by DoMove(). The board has to be in the same
+  // state as after DoMove(), i.e. mirrored back if it was mirrored since.
+  void UndoMove(Move move, const UndoInfo& undo);
+
   std::string DebugString() const;
 
   BitBoard ours() const { return our_pieces_; }
@@ -275,6 +415,49 @@ class ChessBoard {
   };
 
  private:
+  // Checks if the square is under attack from "theirs" (black) with the given
+  // board occupancy, which may differ from the actual one.
+  bool IsUnderAttack(BoardSquare square, BitBoard occupied) const;
+  // Returns all squares attacked by "theirs" (black) pieces with the given
+  // board occupancy.
+  BitBoard TheirAttacks(BitBoard occupied) const;
+  // Returns the pieces of both sides attacking @square with the given board
+  // occupancy.
+  BitBoard AttackersTo(BoardSquare square, BitBoard occupied) const;
+  // Static exchange evaluation value of the piece on @square, 0 if empty.
+  int SEEValue(BoardSquare square) const;
+  // Returns the value of the least valuable piece of @attackers and sets
+  // @square to it. @attackers must not be empty.
+  int LeastValuableAttacker(BitBoard attackers, BoardSquare* square) const;
+  // Starts the exchange of @move: returns the material it captures, including
+  // promotion gains, and sets the value of the piece then standing on the
+  // destination and the occupancy after the move.
+  int SEECapture(Move move, int* piece_value, BitBoard* occupied) const;
+  // Kinds of moves GenerateMoves() produces. All but kPseudolegal are legal.
+  // kAnyLegal is kLegal stopping as soon as some move was found.
+  enum class GenType : uint8_t {
+    kPseudolegal,
+    kLegal,
+    kCaptures,
+    kQuiets,
+    kEvasions,
+    kQuietChecks,
+    kAnyLegal
+  };
+  // Generates moves of the given kind for "ours" (white) into @moves, which
+  // is either a MoveList or a Mobility to count them into.
+  template <GenType kType, typename Moves>
+  void GenerateMoves(Moves* moves) const;
+  // ApplyMove() apart from the hash key updates.
+  bool ApplyMoveUnhashed(Move move);
+  // Key of the given "our"/"their" castling rights bits.
+  uint64_t CastlingsKey(uint8_t castlings) const;
+  // Key of the castling rights, en passant flag and side to move.
+  uint64_t StateKey() const;
+  // XORs the keys of the pieces on @squares into @key, and of the pawns among
+  // them into @pawn_key.
+  void HashSquares(BitBoard squares, uint64_t* key, uint64_t* pawn_key) const;
+
   // All white pieces.
   BitBoard our_pieces_;
   // All black pieces.
@@ -293,6 +476,9 @@ class ChessBoard {
   BoardSquare their_king_;
   Castlings castlings_;
   bool flipped_ = false;  // aka "Black to move".
+  // Zobrist keys of the whole position and of the pawns.
+  uint64_t key_ = 0;
+  uint64_t pawn_key_ = 0;
 };
 
 }  // namespace lczero
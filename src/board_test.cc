@@ -20,9 +20,13 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <iostream>
+#include <vector>
 
+#include "chess/batch_attacks.h"
 #include "chess/bitboard.h"
+#include "chess/color_board.h"
 
 #include "utils/exception.h"
 
@@ -55,6 +59,22 @@ TEST(BoardSquare, BoardSquare) {
   }
 }
 
+TEST(MoveList, InlineStorage) {
+  MoveList moves;
+  EXPECT_TRUE(moves.empty());
+  for (int i = 0; i < 8; ++i) {
+    moves.emplace_back(BoardSquare(8 + i), BoardSquare(16 + i));
+  }
+  EXPECT_EQ(moves.size(), 8);
+  EXPECT_EQ(moves[3], Move("d2d3"));
+
+  MoveList copy = moves;
+  copy.erase(copy.begin() + 2, copy.begin() + 4);
+  EXPECT_EQ(copy.size(), 6);
+  EXPECT_EQ(copy[2], Move("e2e3"));
+  EXPECT_EQ(moves.size(), 8);
+}
+
 TEST(ChessBoard, IllegalFirstRankPawns) {
   ChessBoard board;
   EXPECT_THROW(board.SetFromFen("nqrbkrnr/bnnbnbnn/8/8/8/8/NNNBPNBN/QNRPKPQQ w - - 0 1");,
@@ -210,6 +230,305 @@ TEST(ChessBoard, MoveGenPosition6) {
   EXPECT_EQ(Perft(board, 4), 3894594);
 }
 
+TEST(ChessBoard, SliderBackends) {
+  const SliderBackend default_backend = GetSliderBackend();
+  ChessBoard board;
+  board.SetFromFen(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  for (auto backend : {SliderBackend::kPortable, SliderBackend::kMagic,
+                       SliderBackend::kPext}) {
+    if (!IsSliderBackendSupported(backend)) {
+      EXPECT_THROW(SetSliderBackend(backend), Exception);
+      continue;
+    }
+    SetSliderBackend(backend);
+    EXPECT_EQ(GetSliderBackend(), backend);
+    EXPECT_EQ(Perft(board, 3), 97862) << SliderBackendName(backend);
+  }
+  SetSliderBackend(default_backend);
+}
+
+// Positions stressing checks, pins and en passant discovered checks.
+TEST(ChessBoard, MoveGenChecksAndPins) {
+  const struct {
+    const char* const fen;
+    int depth;
+    int nodes;
+  } kPositions[] = {
+      {"3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1", 6, 1134888},
+      {"8/8/4k3/8/2p5/8/B2P2K1/8 w - - 0 1", 6, 1015133},
+      {"8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1", 6, 1440467},
+      {"r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1", 4, 1274206},
+      {"r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1", 4, 1720476},
+      {"8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1", 5, 1004658},
+      {"8/8/2k5/5q2/5n2/8/5K2/8 b - - 0 1", 4, 23527},
+  };
+  for (const auto& x : kPositions) {
+    ChessBoard board(x.fen);
+    EXPECT_EQ(Perft(board, x.depth), x.nodes) << "Position: " << x.fen;
+  }
+}
+
+namespace {
+// Sorted copy of @moves, so lists can be compared regardless of order.
+std::vector<uint16_t> Sorted(const MoveList& moves) {
+  std::vector<uint16_t> result;
+  for (const auto& move : moves) result.push_back(move.as_packed_int());
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+// Checks the generation modes against legal generation in every position of
+// the tree up to @depth. Returns the number of quiet checks seen.
+int CheckGenerationModes(const ChessBoard& board, int depth) {
+  const auto legal = board.GenerateLegalMoves();
+  const auto captures = board.GenerateCaptures();
+  const auto quiets = board.GenerateQuiets();
+
+  std::vector<uint16_t> both = Sorted(captures);
+  for (auto move : quiets) both.push_back(move.as_packed_int());
+  std::sort(both.begin(), both.end());
+  EXPECT_EQ(both, Sorted(legal)) << board.DebugString();
+  EXPECT_EQ(captures.size() + quiets.size(), legal.size());
+  if (board.IsUnderCheck()) {
+    EXPECT_EQ(Sorted(board.GenerateEvasions()), Sorted(legal))
+        << board.DebugString();
+  }
+
+  MoveList expected_checks;
+  for (auto move : quiets) {
+    auto after = board;
+    after.ApplyMove(move);
+    after.Mirror();
+    if (after.IsUnderCheck()) expected_checks.push_back(move);
+  }
+  EXPECT_EQ(Sorted(board.GenerateQuietChecks()), Sorted(expected_checks))
+      << board.DebugString();
+
+  int checks = expected_checks.size();
+  if (depth == 0) return checks;
+  for (auto move : legal) {
+    auto after = board;
+    after.ApplyMove(move);
+    after.Mirror();
+    checks += CheckGenerationModes(after, depth - 1);
+  }
+  return checks;
+}
+}  // namespace
+
+TEST(ChessBoard, GenerationModes) {
+  const struct {
+    const char* const fen;
+    int depth;
+  } kPositions[] = {
+      {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+       2},
+      {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 2},
+      {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 2},
+      {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 3},
+      {"r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1", 2},
+      {"8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1", 3},
+      {"bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9", 2},
+  };
+  int checks = 0;
+  for (const auto& x : kPositions) {
+    ChessBoard board(x.fen);
+    checks += CheckGenerationModes(board, x.depth);
+  }
+  EXPECT_GT(checks, 0);
+}
+
+namespace {
+// Checks the incremental keys against recomputed ones in every position of the
+// tree up to @depth.
+void CheckHashes(const ChessBoard& board, int depth) {
+  EXPECT_EQ(board.Hash(), board.ComputeHash()) << board.DebugString();
+  EXPECT_EQ(board.PawnHash(), board.ComputePawnHash()) << board.DebugString();
+  if (depth == 0) return;
+  for (auto move : board.GenerateLegalMoves()) {
+    auto after = board;
+    after.ApplyMove(move);
+    after.Mirror();
+    CheckHashes(after, depth - 1);
+  }
+}
+
+ChessBoard ApplyMoves(ChessBoard board,
+                      std::initializer_list<const char*> moves) {
+  for (auto move : moves) {
+    board.ApplyMove(Move(move, board.flipped()));
+    board.Mirror();
+  }
+  return board;
+}
+}  // namespace
+
+TEST(ChessBoard, IncrementalHash) {
+  const char* const kFens[] = {
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9",
+  };
+  for (auto fen : kFens) CheckHashes(ChessBoard(fen), 3);
+}
+
+TEST(ChessBoard, HashTranspositions) {
+  const ChessBoard& start = ChessBoard::kStartposBoard;
+  const auto a = ApplyMoves(start, {"g1f3", "g8f6", "b1c3", "b8c6"});
+  const auto b = ApplyMoves(start, {"b1c3", "b8c6", "g1f3", "g8f6"});
+  EXPECT_EQ(a.Hash(), b.Hash());
+  EXPECT_EQ(a.PawnHash(), start.PawnHash());
+
+  // Same pieces, other side to move.
+  const auto c = ApplyMoves(start, {"g1f3", "g8f6", "f3g1"});
+  const auto d = ApplyMoves(start, {"g1f3", "g8f6", "f3g1", "f6g8"});
+  EXPECT_NE(c.Hash(), d.Hash());
+  EXPECT_EQ(d.Hash(), start.Hash());
+
+  // Castling rights are part of the key.
+  const auto e =
+      ApplyMoves(start, {"g1f3", "g8f6", "h1g1", "f6g8", "g1h1", "g8f6"});
+  EXPECT_NE(e.Hash(), ApplyMoves(start, {"g1f3", "g8f6"}).Hash());
+
+  // Pawn moves change the pawn key.
+  EXPECT_NE(ApplyMoves(start, {"e2e4"}).PawnHash(), start.PawnHash());
+}
+
+namespace {
+// Perft on a single board with DoMove()/UndoMove(), checking that every undo
+// restores the board and its keys.
+int PerftMakeUnmake(ChessBoard* board, int depth) {
+  if (depth == 0) return 1;
+  int nodes = 0;
+  for (auto move : board->GenerateLegalMoves()) {
+    const ChessBoard before = *board;
+    ChessBoard::UndoInfo undo;
+    board->DoMove(move, &undo);
+    board->Mirror();
+    nodes += PerftMakeUnmake(board, depth - 1);
+    board->Mirror();
+    board->UndoMove(move, undo);
+    EXPECT_EQ(*board, before) << before.DebugString() << move.as_string();
+    EXPECT_EQ(board->Hash(), before.Hash());
+    EXPECT_EQ(board->PawnHash(), before.PawnHash());
+  }
+  return nodes;
+}
+}  // namespace
+
+TEST(ChessBoard, MakeUnmake) {
+  const struct {
+    const char* const fen;
+    int depth;
+    int nodes;
+  } kPositions[] = {
+      {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+       3, 97862},
+      {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 4, 43238},
+      {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 3,
+       9467},
+      {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3, 62379},
+      {"bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9", 3,
+       12189},
+      {"2nnrbkr/p1qppppp/8/1ppb4/6PP/3PP3/PPP2P2/BQNNRBKR w HEhe - 1 9", 3,
+       18002},
+  };
+  for (const auto& x : kPositions) {
+    ChessBoard board(x.fen);
+    EXPECT_EQ(PerftMakeUnmake(&board, x.depth), x.nodes) << x.fen;
+  }
+}
+
+namespace {
+template <Color kUs>
+int PerftColorBoard(const ColorBoard& board, int depth) {
+  constexpr Color kThem = kUs == WHITE ? BLACK : WHITE;
+  if (depth == 0) return 1;
+  int nodes = 0;
+  for (auto move : board.GenerateLegalMoves<kUs>()) {
+    ColorBoard new_board = board;
+    new_board.ApplyMove<kUs>(move);
+    nodes += PerftColorBoard<kThem>(new_board, depth - 1);
+  }
+  return nodes;
+}
+
+// Checks that ColorBoard generates the moves of ChessBoard in absolute
+// coordinates, and reaches the same positions, down to @depth plies.
+void CompareColorBoard(const ChessBoard& board, const ColorBoard& color_board,
+                       int depth) {
+  EXPECT_TRUE(ColorBoard(board) == color_board) << color_board.DebugString();
+  EXPECT_EQ(color_board.IsUnderCheck(), board.IsUnderCheck())
+      << board.DebugString();
+  EXPECT_EQ(color_board.side_to_move() == BLACK, board.flipped());
+  const MoveList moves = board.GenerateLegalMoves();
+  const MoveList color_moves = color_board.GenerateLegalMoves();
+  ASSERT_EQ(color_moves.size(), moves.size()) << color_board.DebugString();
+  for (auto move : moves) {
+    Move absolute = move;
+    if (board.flipped()) absolute.Mirror();
+    EXPECT_NE(std::find(color_moves.begin(), color_moves.end(), absolute),
+              color_moves.end())
+        << absolute.as_string() << "\n"
+        << color_board.DebugString();
+    if (depth <= 1) continue;
+    ChessBoard child = board;
+    child.ApplyMove(move);
+    child.Mirror();
+    ColorBoard color_child = color_board;
+    color_child.ApplyMove(absolute);
+    CompareColorBoard(child, color_child, depth - 1);
+  }
+}
+}  // namespace
+
+TEST(ColorBoard, Perft) {
+  const struct {
+    const char* const fen;
+    int depth;
+    int nodes;
+  } kPositions[] = {
+      {ChessBoard::kStartposFen, 4, 197281},
+      {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+       3, 97862},
+      {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5, 674624},
+      {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4,
+       422333},
+      {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3, 62379},
+      {"3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1", 6, 1134888},
+      {"8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1", 6, 1440467},
+      {"r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1", 4, 1720476},
+      {"bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9", 3,
+       12189},
+      {"2nnrbkr/p1qppppp/8/1ppb4/6PP/3PP3/PPP2P2/BQNNRBKR w HEhe - 1 9", 3,
+       18002},
+  };
+  for (const auto& x : kPositions) {
+    const ColorBoard board(x.fen);
+    const int nodes = board.side_to_move() == WHITE
+                          ? PerftColorBoard<WHITE>(board, x.depth)
+                          : PerftColorBoard<BLACK>(board, x.depth);
+    EXPECT_EQ(nodes, x.nodes) << x.fen;
+    CompareColorBoard(ChessBoard(x.fen), board, 2);
+  }
+}
+
+TEST(ColorBoard, Castling) {
+  ColorBoard board("r3k2r/8/8/8/8/8/8/R3K2R b KQkq - 0 1");
+  // Castling encoded the legacy way, then the modern way.
+  board.ApplyMove(Move("e8g8"));
+  EXPECT_TRUE(board == ColorBoard("r4rk1/8/8/8/8/8/8/R3K2R w KQ - 1 2"))
+      << board.DebugString();
+  ColorBoard modern("r3k2r/8/8/8/8/8/8/R3K2R b KQkq - 0 1");
+  modern.ApplyMove(Move("e8h8"));
+  EXPECT_TRUE(modern == board);
+  board.ApplyMove(Move("a1a8"));
+  EXPECT_TRUE(board == ColorBoard("R4rk1/8/8/8/8/8/8/4K2R b K - 0 2"))
+      << board.DebugString();
+}
+
 namespace {
 const struct {
   const char* const fen;
@@ -2284,10 +2603,371 @@ TEST(ChessBoard, InvalidEnPassantFromKnightPromotion) {
   EXPECT_TRUE(board.en_passant().empty());
 }
 
+TEST(ChessBoard, SEE) {
+  const struct {
+    const char* fen;
+    const char* move;
+    int see;
+  } kCases[] = {
+      // Undefended pawn.
+      {"1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1", "e1e5", 100},
+      // Queen takes a pawn defended by a pawn.
+      {"4k3/8/3p4/4p3/8/8/8/4QK2 w - - 0 1", "e1e5", -800},
+      // Rook takes a pawn defended by a rook, with or without a second rook
+      // x-raying through the first.
+      {"4r1k1/8/8/4p3/8/8/4R3/4R1K1 w - - 0 1", "e2e5", 100},
+      {"4r1k1/8/8/4p3/8/8/4R3/6K1 w - - 0 1", "e2e5", -400},
+      // Bishop takes a knight defended by a pawn, the queen behind it
+      // recaptures.
+      {"6k1/8/5p2/4n3/8/2B5/1Q6/6K1 w - - 0 1", "c3e5", 100},
+      // The king can't recapture on a defended square.
+      {"8/8/8/3pk3/8/3R4/3R4/6K1 w - - 0 1", "d3d5", 100},
+      // En passant.
+      {"4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 1", "e5d6", 100},
+      // Promotions, with and without capture.
+      {"4k3/P7/8/8/8/8/8/4K3 w - - 0 1", "a7a8q", 800},
+      {"1r2k3/P7/8/8/8/8/8/4K3 w - - 0 1", "a7a8q", -100},
+      {"1r2k3/P7/8/8/8/8/8/4K3 w - - 0 1", "a7b8q", 1300},
+      {"rr2k3/P7/8/8/8/8/8/4K3 w - - 0 1", "a7b8q", 400},
+      // Castling and quiet moves.
+      {"4k3/8/8/8/8/8/8/4K2R w K - 0 1", "e1h1", 0},
+      {"4k3/8/8/3p4/8/8/8/2R1K3 w - - 0 1", "c1c4", -500},
+  };
+  for (const auto& test_case : kCases) {
+    ChessBoard board(test_case.fen);
+    const Move move(test_case.move);
+    EXPECT_EQ(board.SEE(move), test_case.see) << test_case.fen;
+    EXPECT_TRUE(board.SEEGreaterOrEqual(move, test_case.see)) << test_case.fen;
+    EXPECT_FALSE(board.SEEGreaterOrEqual(move, test_case.see + 1))
+        << test_case.fen;
+  }
+
+  // Black to move, on the mirrored board.
+  ChessBoard board("4k3/8/4p3/3P4/8/8/8/Q3K3 b - - 0 1");
+  EXPECT_EQ(board.SEE(Move("e6d5", true)), 100);
+}
+
+// SEEGreaterOrEqual() agrees with SEE() for all moves of some positions.
+TEST(ChessBoard, SEEGreaterOrEqual) {
+  for (const char* fen : {
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - "
+           "0 1",
+           "1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1",
+           "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1",
+           "2r3k1/1q3ppp/p3p3/1p1nP3/3Q4/P2B1N2/1P3PPP/2R3K1 w - - 0 1",
+       }) {
+    ChessBoard board(fen);
+    for (auto move : board.GenerateLegalMoves()) {
+      const int see = board.SEE(move);
+      for (int threshold : {-1000, -500, -200, -100, 0, 100, 200, 500}) {
+        EXPECT_EQ(board.SEEGreaterOrEqual(move, threshold), see >= threshold)
+            << fen << " " << move.as_string() << " " << threshold;
+      }
+    }
+  }
+}
+
+namespace {
+// Unlike as_packed_int(), tells knight promotions from moves without
+// promotion.
+int MoveKey(Move move) {
+  return static_cast<int>(move.promotion()) * 64 * 64 +
+         move.from().as_int() * 64 + move.to().as_int();
+}
+
+std::vector<int> SortedKeys(const MoveList& moves) {
+  std::vector<int> result;
+  for (const auto& move : moves) result.push_back(MoveKey(move));
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+// Checks IsPseudoLegal() and IsLegal() against the generated move lists for
+// every encodable move.
+void CheckMoveValidation(const ChessBoard& board) {
+  const auto pseudolegal = SortedKeys(board.GeneratePseudolegalMoves());
+  const auto legal = SortedKeys(board.GenerateLegalMoves());
+  const Move::Promotion kPromotions[] = {
+      Move::Promotion::None, Move::Promotion::Queen, Move::Promotion::Rook,
+      Move::Promotion::Bishop, Move::Promotion::Knight};
+  for (int from = 0; from < 64; from++) {
+    for (int to = 0; to < 64; to++) {
+      for (auto promotion : kPromotions) {
+        const Move move(BoardSquare(from), BoardSquare(to), promotion);
+        const int key = MoveKey(move);
+        EXPECT_EQ(board.IsPseudoLegal(move),
+                  std::binary_search(pseudolegal.begin(), pseudolegal.end(),
+                                     key))
+            << board.DebugString() << move.as_string();
+        EXPECT_EQ(board.IsLegal(move),
+                  std::binary_search(legal.begin(), legal.end(), key))
+            << board.DebugString() << move.as_string();
+      }
+    }
+  }
+}
+}  // namespace
+
+TEST(ChessBoard, IsPseudoLegalAndIsLegal) {
+  for (const char* fen : {
+           ChessBoard::kStartposFen,
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - "
+           "0 1",
+           "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+           "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+           "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+           // En passant captures which expose the king along the rank.
+           "8/8/8/KPp4r/8/8/8/6k1 w - c6 0 1",
+           "8/8/8/1k6/3Pp3/8/8/4KQ2 b - d3 0 1",
+           // Castling with the king shielded by the castling rook.
+           "1r2k3/8/8/8/8/8/8/RK6 w A - 0 1",
+       }) {
+    ChessBoard board(fen);
+    CheckMoveValidation(board);
+    for (auto move : board.GenerateLegalMoves()) {
+      ChessBoard child = board;
+      child.ApplyMove(move);
+      child.Mirror();
+      CheckMoveValidation(child);
+    }
+  }
+}
+
+TEST(ChessBoard, GivesCheck) {
+  for (const char* fen : {
+           ChessBoard::kStartposFen,
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - "
+           "0 1",
+           "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+           "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+           "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+           // Discovered checks by en passant, along the rank and diagonal.
+           "8/8/8/R2pP2k/8/8/8/4K3 w - d6 0 1",
+           "6k1/8/8/3pP3/8/1B6/8/4K3 w - d6 0 1",
+           // Promotions checking through the square the pawn leaves.
+           "K7/4P3/8/8/8/8/8/4k3 w - - 0 1",
+           "4k3/1P6/8/8/8/8/8/4K3 w - - 0 1",
+           // Castling rooks checking, and the king uncovering a check.
+           "5k2/8/8/8/8/8/8/R3K2R w KQ - 0 1",
+           "3k4/8/8/8/8/8/8/R3K2R w KQ - 0 1",
+           "8/8/8/8/k7/8/2K5/3Q4 w - - 0 1",
+       }) {
+    ChessBoard board(fen);
+    const CheckInfo check_info = board.GenerateCheckInfo();
+    for (auto move : board.GenerateLegalMoves()) {
+      ChessBoard child = board;
+      child.ApplyMove(move);
+      child.Mirror();
+      EXPECT_EQ(board.GivesCheck(move, check_info), child.IsUnderCheck())
+          << board.DebugString() << move.as_string();
+      const CheckInfo child_info = child.GenerateCheckInfo();
+      for (auto child_move : child.GenerateLegalMoves()) {
+        ChessBoard grandchild = child;
+        grandchild.ApplyMove(child_move);
+        grandchild.Mirror();
+        EXPECT_EQ(child.GivesCheck(child_move, child_info),
+                  grandchild.IsUnderCheck())
+            << child.DebugString() << child_move.as_string();
+      }
+    }
+  }
+}
+
+namespace {
+// Checks CountLegalMoves(), HasAnyLegalMove() and GetMobility() against the
+// generated legal moves.
+void CheckMoveCounts(const ChessBoard& board) {
+  const MoveList moves = board.GenerateLegalMoves();
+  Mobility expected;
+  for (auto move : moves) {
+    const BoardSquare from = move.from();
+    if (board.pawns().get(from)) {
+      expected.pawns++;
+    } else if (board.knights().get(from)) {
+      expected.knights++;
+    } else if (board.bishops().get(from)) {
+      expected.bishops++;
+    } else if (board.rooks().get(from)) {
+      expected.rooks++;
+    } else if (board.queens().get(from)) {
+      expected.queens++;
+    } else {
+      expected.king++;
+    }
+  }
+  const Mobility mobility = board.GetMobility();
+  EXPECT_EQ(mobility.pawns, expected.pawns) << board.DebugString();
+  EXPECT_EQ(mobility.knights, expected.knights) << board.DebugString();
+  EXPECT_EQ(mobility.bishops, expected.bishops) << board.DebugString();
+  EXPECT_EQ(mobility.rooks, expected.rooks) << board.DebugString();
+  EXPECT_EQ(mobility.queens, expected.queens) << board.DebugString();
+  EXPECT_EQ(mobility.king, expected.king) << board.DebugString();
+  EXPECT_EQ(board.CountLegalMoves(), static_cast<int>(moves.size()))
+      << board.DebugString();
+  EXPECT_EQ(board.HasAnyLegalMove(), !moves.empty()) << board.DebugString();
+}
+}  // namespace
+
+TEST(ChessBoard, CountLegalMovesAndMobility) {
+  for (const char* fen : {
+           ChessBoard::kStartposFen,
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - "
+           "0 1",
+           "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+           "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+           "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+           // Pinned pawns, one of them able to capture its pinner.
+           "4k3/8/8/8/b7/8/2P1P3/3K4 w - - 0 1",
+           "4k3/8/8/8/8/5q2/4P3/3K4 w - - 0 1",
+           "4r3/8/8/8/8/8/4P3/4K3 w - - 0 1",
+           // Checkmate, stalemate and a king with only a capture.
+           "rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3",
+           "7k/5Q2/6K1/8/8/8/8/8 b - - 0 1",
+           "k7/1R6/8/8/8/8/8/K7 b - - 0 1",
+       }) {
+    ChessBoard board(fen);
+    CheckMoveCounts(board);
+    for (auto move : board.GenerateLegalMoves()) {
+      ChessBoard child = board;
+      child.ApplyMove(move);
+      child.Mirror();
+      CheckMoveCounts(child);
+    }
+  }
+}
+
+namespace {
+// Checks TheirAttacks(), GetAttackMap() and IsUnderCheck() against
+// IsUnderAttack().
+void CheckAttackMap(const ChessBoard& board) {
+  const bool in_check = board.IsUnderCheck();
+  const BitBoard attacks = board.TheirAttacks();
+  const AttackMap map = board.GetAttackMap();
+  EXPECT_EQ(map.all(), attacks) << board.DebugString();
+  EXPECT_EQ(board.IsUnderCheck(), in_check) << board.DebugString();
+  const BoardSquare our_king = *(board.kings() & board.ours()).begin();
+  EXPECT_EQ(attacks.get(our_king), in_check) << board.DebugString();
+  EXPECT_EQ(map.pawns.empty(), (board.pawns() & board.theirs()).empty())
+      << board.DebugString();
+  EXPECT_EQ(map.knights.empty(), (board.knights() & board.theirs()).empty())
+      << board.DebugString();
+  const BoardSquare their_king = *(board.kings() & board.theirs()).begin();
+  for (int i = 0; i < 64; i++) {
+    const BoardSquare square(i);
+    // IsUnderAttack() counts their king as attacking its own square.
+    if (square == their_king) continue;
+    // Only squares behind our king from a checker may be attacked without it.
+    if (!in_check) {
+      EXPECT_EQ(attacks.get(square), board.IsUnderAttack(square))
+          << square.as_string() << "\n"
+          << board.DebugString();
+    } else if (board.IsUnderAttack(square)) {
+      EXPECT_TRUE(attacks.get(square))
+          << square.as_string() << "\n"
+          << board.DebugString();
+    }
+  }
+}
+}  // namespace
+
+TEST(ChessBoard, AttackMap) {
+  for (const char* fen : {
+           ChessBoard::kStartposFen,
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - "
+           "0 1",
+           "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+           "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+           // The king in check along a rank and a diagonal.
+           "8/8/8/8/8/8/1k6/r3K3 w - - 0 1",
+           "8/8/8/8/1q6/8/8/4K2k w - - 0 1",
+       }) {
+    ChessBoard board(fen);
+    CheckAttackMap(board);
+    const BitBoard attacks = board.TheirAttacks();
+    for (auto move : board.GenerateLegalMoves()) {
+      ChessBoard child = board;
+      child.ApplyMove(move);
+      child.Mirror();
+      CheckAttackMap(child);
+      // Make/unmake reaches the same attacks as copy-make, and restores them.
+      ChessBoard::UndoInfo undo;
+      board.DoMove(move, &undo);
+      board.Mirror();
+      EXPECT_EQ(board.TheirAttacks(), child.TheirAttacks());
+      board.Mirror();
+      board.UndoMove(move, undo);
+      EXPECT_EQ(board.TheirAttacks(), attacks);
+    }
+  }
+}
+
+// The children of a few positions, with and without checks, in batches whose
+// sizes don't divide into the vector widths.
+TEST(ChessBoard, BatchAttacks) {
+  const BatchBackend default_backend = GetBatchBackend();
+  std::vector<ChessBoard> boards;
+  for (const char* fen : {
+           ChessBoard::kStartposFen,
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - "
+           "0 1",
+           "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+           "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+           "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+       }) {
+    const ChessBoard board(fen);
+    boards.push_back(board);
+    for (auto move : board.GenerateLegalMoves()) {
+      ChessBoard child = board;
+      child.ApplyMove(move);
+      child.Mirror();
+      boards.push_back(child);
+    }
+  }
+
+  SetBatchBackend(BatchBackend::kScalar);
+  BatchAttacks expected;
+  ComputeBatchAttacks(boards.data(), boards.size(), &expected);
+  ASSERT_EQ(expected.all.size(), boards.size());
+  for (size_t i = 0; i < boards.size(); i++) {
+    // Apart from checks, the king doesn't block the attacks through it.
+    if (boards[i].IsUnderCheck()) continue;
+    const AttackMap map = boards[i].GetAttackMap();
+    EXPECT_EQ(BitBoard(expected.pawns[i]), map.pawns);
+    EXPECT_EQ(BitBoard(expected.knights[i]), map.knights);
+    EXPECT_EQ(BitBoard(expected.sliders[i]),
+              map.bishops | map.rooks | map.queens);
+    EXPECT_EQ(BitBoard(expected.king[i]), map.king);
+    EXPECT_EQ(BitBoard(expected.all[i]), map.all());
+    EXPECT_EQ(expected.count[i], map.all().count());
+  }
+
+  for (auto backend : {BatchBackend::kAvx2, BatchBackend::kAvx512}) {
+    if (!IsBatchBackendSupported(backend)) {
+      EXPECT_THROW(SetBatchBackend(backend), Exception);
+      continue;
+    }
+    SetBatchBackend(backend);
+    for (size_t size : {boards.size(), size_t{13}, size_t{3}, size_t{0}}) {
+      BatchAttacks attacks;
+      ComputeBatchAttacks(boards.data(), size, &attacks);
+      ASSERT_EQ(attacks.all.size(), size);
+      for (size_t i = 0; i < size; i++) {
+        EXPECT_EQ(attacks.pawns[i], expected.pawns[i]);
+        EXPECT_EQ(attacks.knights[i], expected.knights[i]);
+        EXPECT_EQ(attacks.sliders[i], expected.sliders[i]);
+        EXPECT_EQ(attacks.king[i], expected.king[i]);
+        EXPECT_EQ(attacks.all[i], expected.all[i]);
+        EXPECT_EQ(attacks.count[i], expected.count[i])
+            << BatchBackendName(backend) << " " << i;
+      }
+    }
+  }
+  SetBatchBackend(default_backend);
+}
+
 }  // namespace lczero
 
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
-  lczero::InitializeMagicBitboards();
   return RUN_ALL_TESTS();
 }
@@ -0,0 +1,556 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018-2019 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "color_board.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cctype>
+#include <cstdlib>
+#include <utility>
+
+namespace lczero {
+
+namespace {
+// Attacks of the pieces which take single steps on an empty board, for every
+// square. ChessBoard's tables are private to board.cc.
+template <size_t N>
+constexpr std::array<BitBoard, 64> MakeStepAttacks(
+    const std::pair<int, int> (&steps)[N]) {
+  std::array<BitBoard, 64> attacks{};
+  for (int square = 0; square < 64; square++) {
+    uint64_t board = 0;
+    for (const auto& step : steps) {
+      const int row = square / 8 + step.first;
+      const int col = square % 8 + step.second;
+      if (BoardSquare::IsValid(row, col)) {
+        board |= BoardSquare(row, col).as_board();
+      }
+    }
+    attacks[square] = board;
+  }
+  return attacks;
+}
+
+constexpr std::pair<int, int> kKingSteps[] = {
+    {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, 1}, {1, -1}, {-1, -1}};
+constexpr std::pair<int, int> kKnightSteps[] = {
+    {2, 1}, {2, -1}, {-2, 1}, {-2, -1}, {1, 2}, {1, -2}, {-1, 2}, {-1, -2}};
+// Squares of a white and of a black pawn attacking a square.
+constexpr std::pair<int, int> kWhitePawnSteps[] = {{-1, -1}, {-1, 1}};
+constexpr std::pair<int, int> kBlackPawnSteps[] = {{1, -1}, {1, 1}};
+
+constexpr std::array<BitBoard, 64> kKingAttacks = MakeStepAttacks(kKingSteps);
+constexpr std::array<BitBoard, 64> kKnightAttacks =
+    MakeStepAttacks(kKnightSteps);
+// Pawns never stand on the first or last rank, where pawns_ holds the en
+// passant flags instead.
+constexpr std::array<BitBoard, 64> kWhitePawnAttackers = [] {
+  auto attacks = MakeStepAttacks(kWhitePawnSteps);
+  for (auto& board : attacks) board = board.as_int() & ~0xFFULL;
+  return attacks;
+}();
+constexpr std::array<BitBoard, 64> kBlackPawnAttackers = [] {
+  auto attacks = MakeStepAttacks(kBlackPawnSteps);
+  for (auto& board : attacks) board = board.as_int() & ~0xFF00000000000000ULL;
+  return attacks;
+}();
+
+// Squares strictly between two squares sharing a rank, file or diagonal, and
+// the whole line through them, edge to edge. Both are empty for squares which
+// are not aligned.
+struct LineTables {
+  uint64_t between_[64][64];
+  uint64_t line_[64][64];
+};
+
+constexpr LineTables MakeLineTables() {
+  LineTables tables{};
+  for (int square = 0; square < 64; square++) {
+    for (const auto& direction : kKingSteps) {
+      uint64_t line = BoardSquare(square).as_board();
+      for (int sign : {1, -1}) {
+        int row = square / 8 + sign * direction.first;
+        int col = square % 8 + sign * direction.second;
+        while (BoardSquare::IsValid(row, col)) {
+          line |= BoardSquare(row, col).as_board();
+          row += sign * direction.first;
+          col += sign * direction.second;
+        }
+      }
+      uint64_t between = 0;
+      int row = square / 8 + direction.first;
+      int col = square % 8 + direction.second;
+      while (BoardSquare::IsValid(row, col)) {
+        const int other = row * 8 + col;
+        tables.between_[square][other] = between;
+        tables.line_[square][other] = line;
+        between |= BoardSquare(other).as_board();
+        row += direction.first;
+        col += direction.second;
+      }
+    }
+  }
+  return tables;
+}
+
+constexpr LineTables kLineTables = MakeLineTables();
+
+inline BitBoard Between(const BoardSquare a, const BoardSquare b) {
+  return kLineTables.between_[a.as_int()][b.as_int()];
+}
+
+inline BitBoard Line(const BoardSquare a, const BoardSquare b) {
+  return kLineTables.line_[a.as_int()][b.as_int()];
+}
+
+// Returns the pieces which are the only piece of @occupied between @king and
+// one of @snipers.
+inline BitBoard SoleBlockers(const BoardSquare king, const BitBoard snipers,
+                             const BitBoard occupied) {
+  BitBoard blockers;
+  for (auto sniper : snipers) {
+    const uint64_t between = (Between(king, sniper) & occupied).as_int();
+    if (between && !(between & (between - 1))) blockers = blockers | between;
+  }
+  return blockers;
+}
+
+constexpr uint64_t kFileA = 0x0101010101010101ULL;
+constexpr uint64_t kFileH = 0x8080808080808080ULL;
+constexpr uint64_t kRank1 = 0x00000000000000FFULL;
+constexpr uint64_t kRank3 = 0x0000000000FF0000ULL;
+constexpr uint64_t kRank6 = 0x0000FF0000000000ULL;
+constexpr uint64_t kRank8 = 0xFF00000000000000ULL;
+
+constexpr Move::Promotion kPromotions[] = {
+    Move::Promotion::Queen,
+    Move::Promotion::Rook,
+    Move::Promotion::Bishop,
+    Move::Promotion::Knight,
+};
+
+// Squares of the first rank from @a to @b inclusive, in any order.
+inline uint64_t FirstRankSpan(uint8_t a, uint8_t b) {
+  return (2ULL << std::max(a, b)) - (1ULL << std::min(a, b));
+}
+
+// Adds a move from @source to every square of @destinations.
+inline void AddMoves(BoardSquare source, BitBoard destinations,
+                     MoveList* moves) {
+  for (auto destination : destinations) {
+    moves->emplace_back(source, destination);
+  }
+}
+
+// Shifts @board by @shift squares, towards rank 8 if positive and towards
+// rank 1 if negative.
+constexpr uint64_t Shift(uint64_t board, int shift) {
+  return shift > 0 ? board << shift : board >> -shift;
+}
+
+// Returns the squares of @kSide's pawns which would attack @square.
+template <Color kSide>
+inline BitBoard PawnAttackers(BoardSquare square) {
+  return kSide == WHITE ? kWhitePawnAttackers[square.as_int()]
+                        : kBlackPawnAttackers[square.as_int()];
+}
+}  // namespace
+
+ColorBoard::ColorBoard(const ChessBoard& board) {
+  ChessBoard white = board;
+  if (white.flipped()) white.Mirror();
+  pieces_[WHITE] = white.ours();
+  pieces_[BLACK] = white.theirs();
+  rooks_ = white.rooks() | white.queens();
+  bishops_ = white.bishops() | white.queens();
+  pawns_ = white.pawns() | white.en_passant();
+  kings_[WHITE] = *(white.kings() & white.ours()).begin();
+  kings_[BLACK] = *(white.kings() & white.theirs()).begin();
+  castlings_ = white.castlings();
+  side_to_move_ = board.flipped() ? BLACK : WHITE;
+}
+
+void ColorBoard::SetFromFen(std::string fen, int* rule50_ply, int* moves) {
+  ChessBoard board;
+  board.SetFromFen(std::move(fen), rule50_ply, moves);
+  *this = ColorBoard(board);
+}
+
+template <Color kSide>
+BitBoard ColorBoard::Attacks(const BitBoard occupied) const {
+  const uint64_t pawns = (pieces_[kSide] & pawns_ & ChessBoard::kPawnMask).as_int();
+  BitBoard attacks = kSide == WHITE ? ((pawns & ~kFileA) << 7) |
+                                          ((pawns & ~kFileH) << 9)
+                                    : ((pawns & ~kFileA) >> 9) |
+                                          ((pawns & ~kFileH) >> 7);
+  attacks = attacks | kKingAttacks[kings_[kSide].as_int()];
+  for (auto source : pieces_[kSide] & knights()) {
+    attacks = attacks | kKnightAttacks[source.as_int()];
+  }
+  for (auto source : pieces_[kSide] & rooks_) {
+    attacks = attacks | RookAttacks(source, occupied);
+  }
+  for (auto source : pieces_[kSide] & bishops_) {
+    attacks = attacks | BishopAttacks(source, occupied);
+  }
+  return attacks;
+}
+
+template <Color kSide>
+BitBoard ColorBoard::AttackersTo(const BoardSquare square,
+                                 const BitBoard occupied) const {
+  return ((PawnAttackers<kSide>(square) & pawns_) |
+          (kKnightAttacks[square.as_int()] & knights()) |
+          (kKingAttacks[square.as_int()] & kings()) |
+          (RookAttacks(square, occupied) & rooks_) |
+          (BishopAttacks(square, occupied) & bishops_)) &
+         pieces_[kSide] & occupied;
+}
+
+template <Color kUs>
+MoveList ColorBoard::GenerateLegalMoves() const {
+  constexpr Color kThem = kUs == WHITE ? BLACK : WHITE;
+  // Pawn steps forward and captures towards files a and h.
+  constexpr int kPush = kUs == WHITE ? 8 : -8;
+  constexpr int kCaptureA = kUs == WHITE ? 7 : -9;
+  constexpr int kCaptureH = kUs == WHITE ? 9 : -7;
+  constexpr uint64_t kDoublePushRank = kUs == WHITE ? kRank3 : kRank6;
+  constexpr uint64_t kPromotionRank = kUs == WHITE ? kRank8 : kRank1;
+  // Their en passant flags, and the ranks their pawn is taken on and from.
+  constexpr uint64_t kEnPassantFlags = kUs == WHITE ? kRank8 : kRank1;
+  constexpr int kEnPassantRow = kUs == WHITE ? ChessBoard::RANK_6
+                                             : ChessBoard::RANK_3;
+  constexpr int kCapturedRow = kUs == WHITE ? ChessBoard::RANK_5
+                                            : ChessBoard::RANK_4;
+  // First square of our back rank.
+  constexpr uint8_t kBackRank = kUs == WHITE ? ChessBoard::A1 : ChessBoard::A8;
+
+  MoveList moves;
+  const BitBoard ours = pieces_[kUs];
+  const BitBoard theirs = pieces_[kThem];
+  const BitBoard occupied = ours | theirs;
+  const BoardSquare king = kings_[kUs];
+
+  // Same check mask and pins as in ChessBoard::GenerateMoves().
+  const BitBoard checkers = AttackersTo<kThem>(king, occupied);
+  uint64_t check_mask = ~0ULL;
+  if (!checkers.empty()) {
+    const BoardSquare checker = *checkers.begin();
+    if ((checkers - checker).empty()) {
+      check_mask = (Between(king, checker) | checker.as_board()).as_int();
+    } else {
+      check_mask = 0;
+    }
+  }
+  const BitBoard snipers =
+      (RookAttacks(king, BitBoard()) & theirs & rooks_) |
+      (BishopAttacks(king, BitBoard()) & theirs & bishops_);
+  const BitBoard pinned_pieces = SoleBlockers(king, snipers, occupied) & ours;
+  auto pin_allows = [&](BoardSquare source, BoardSquare destination) {
+    return !pinned_pieces.get(source) || Line(king, source).get(destination);
+  };
+  const uint64_t targets = ~ours.as_int() & check_mask;
+  auto piece_targets = [&](BoardSquare source) {
+    if (!pinned_pieces.get(source)) return targets;
+    return targets & Line(king, source).as_int();
+  };
+
+  // Non-king moves are all impossible in double check.
+  if (check_mask) {
+    const BitBoard our_pawns = ours & pawns_ & ChessBoard::kPawnMask;
+    auto add_pawn_moves = [&](uint64_t destinations, int shift) {
+      for (auto destination : BitBoard(destinations & check_mask)) {
+        const BoardSquare source(destination.as_int() - shift);
+        if (!pin_allows(source, destination)) continue;
+        if (destination.as_board() & kPromotionRank) {
+          for (auto promotion : kPromotions) {
+            moves.emplace_back(source, destination, promotion);
+          }
+        } else {
+          moves.emplace_back(source, destination);
+        }
+      }
+    };
+    const uint64_t pawns = our_pawns.as_int();
+    const uint64_t push = Shift(pawns, kPush) & ~occupied.as_int();
+    add_pawn_moves(push, kPush);
+    add_pawn_moves(
+        Shift(push & kDoublePushRank, kPush) & ~occupied.as_int(), 2 * kPush);
+    add_pawn_moves(Shift(pawns & ~kFileA, kCaptureA) & theirs.as_int(),
+                   kCaptureA);
+    add_pawn_moves(Shift(pawns & ~kFileH, kCaptureH) & theirs.as_int(),
+                   kCaptureH);
+
+    // En passant. Taking the pawn off the board may uncover any attack on our
+    // king, or remove the checker.
+    for (auto flag : pawns_ & kEnPassantFlags) {
+      const BoardSquare destination(kEnPassantRow, flag.col());
+      const BoardSquare captured(kCapturedRow, flag.col());
+      for (auto source : PawnAttackers<kUs>(destination) & our_pawns) {
+        const BitBoard after =
+            (occupied - source - captured) | destination.as_board();
+        if (AttackersTo<kThem>(king, after).empty()) {
+          moves.emplace_back(source, destination);
+        }
+      }
+    }
+
+    // Knights. A pinned knight can never move.
+    for (auto source : (ours & knights()) - pinned_pieces) {
+      AddMoves(source, kKnightAttacks[source.as_int()] & targets, &moves);
+    }
+    // Bishops and rooks; queens are in both sets.
+    for (auto source : ours & bishops_) {
+      AddMoves(source,
+               BishopAttacks(source, occupied) & piece_targets(source),
+               &moves);
+    }
+    for (auto source : ours & rooks_) {
+      AddMoves(source, RookAttacks(source, occupied) & piece_targets(source),
+               &moves);
+    }
+  }
+
+  // King. It must not block attacks along the line it steps on.
+  const BitBoard attacked = Attacks<kThem>(occupied - king);
+  AddMoves(king, (kKingAttacks[king.as_int()] - ours) - attacked, &moves);
+
+  // Castlings, with the same conditions as in ChessBoard::GenerateMoves().
+  if (!checkers.empty()) return moves;
+  auto add_castling = [&](uint8_t rook, uint8_t king_dst, uint8_t rook_dst) {
+    const uint8_t from = king.as_int() - kBackRank;
+    const BoardSquare rook_square(kBackRank + rook);
+    const BitBoard path =
+        FirstRankSpan(std::min({from, rook, king_dst, rook_dst}),
+                      std::max({from, rook, king_dst, rook_dst}))
+        << kBackRank;
+    if (path.intersects(occupied - king - rook_square)) return;
+    const uint64_t king_path =
+        from == king_dst ? 1ULL << from
+                         : FirstRankSpan(from, king_dst) & ~(1ULL << king_dst);
+    if (attacked.intersects(king_path << kBackRank)) return;
+    const BitBoard after = (occupied - king - rook_square) |
+                           BoardSquare(kBackRank + rook_dst).as_board();
+    if (!AttackersTo<kThem>(BoardSquare(kBackRank + king_dst), after).empty()) {
+      return;
+    }
+    moves.emplace_back(king, rook_square);
+  };
+  if (kUs == WHITE ? castlings_.we_can_000() : castlings_.they_can_000()) {
+    add_castling(kUs == WHITE ? castlings_.our_queenside_rook()
+                              : castlings_.their_queenside_rook(),
+                 ChessBoard::C1, ChessBoard::D1);
+  }
+  if (kUs == WHITE ? castlings_.we_can_00() : castlings_.they_can_00()) {
+    add_castling(kUs == WHITE ? castlings_.our_kingside_rook()
+                              : castlings_.their_kingside_rook(),
+                 ChessBoard::G1, ChessBoard::F1);
+  }
+  return moves;
+}
+
+template <Color kUs>
+void ColorBoard::ApplyMove(Move move) {
+  constexpr Color kThem = kUs == WHITE ? BLACK : WHITE;
+  constexpr int kBackRow = kUs == WHITE ? ChessBoard::RANK_1 : ChessBoard::RANK_8;
+  constexpr int kTheirBackRow =
+      kUs == WHITE ? ChessBoard::RANK_8 : ChessBoard::RANK_1;
+  constexpr int kPromotionRow = kTheirBackRow;
+  constexpr uint8_t kBackRank = kBackRow * 8;
+  assert(side_to_move_ == kUs);
+  BitBoard& ours = pieces_[kUs];
+  BitBoard& theirs = pieces_[kThem];
+  const BoardSquare from = move.from();
+  const BoardSquare to = move.to();
+  const int from_row = from.row();
+  const int from_col = from.col();
+  const int to_row = to.row();
+  const int to_col = to.col();
+  const BitBoard pawns = pawns_ & ChessBoard::kPawnMask;
+
+  auto reset_castlings = [&](bool kingside, bool queenside) {
+    if (kUs == WHITE) {
+      if (kingside) castlings_.reset_we_can_00();
+      if (queenside) castlings_.reset_we_can_000();
+    } else {
+      if (kingside) castlings_.reset_they_can_00();
+      if (queenside) castlings_.reset_they_can_000();
+    }
+  };
+  auto reset_their_castlings = [&](bool kingside, bool queenside) {
+    if (kUs == WHITE) {
+      if (kingside) castlings_.reset_they_can_00();
+      if (queenside) castlings_.reset_they_can_000();
+    } else {
+      if (kingside) castlings_.reset_we_can_00();
+      if (queenside) castlings_.reset_we_can_000();
+    }
+  };
+
+  // Castlings, encoded as the king taking its rook, or by the king's two
+  // square step from the e file.
+  int rook_src = -1;
+  int king_dst = 0;
+  int rook_dst = 0;
+  if (from == kings_[kUs] && from_row == kBackRow && to_row == kBackRow) {
+    const bool kingside = to_col > from_col;
+    if ((rooks_ - bishops_).get(to) && ours.get(to)) {
+      rook_src = to.as_int();
+    } else if (from_col == ChessBoard::FILE_E &&
+               (to_col == ChessBoard::FILE_G || to_col == ChessBoard::FILE_C)) {
+      rook_src = kBackRank + (kingside ? ChessBoard::FILE_H : ChessBoard::FILE_A);
+    }
+    king_dst = kBackRank + (kingside ? ChessBoard::G1 : ChessBoard::C1);
+    rook_dst = kBackRank + (kingside ? ChessBoard::F1 : ChessBoard::D1);
+  }
+  const bool en_passant = pawns.get(from) && from_col != to_col &&
+                          !theirs.get(to);
+  const BoardSquare captured =
+      en_passant ? BoardSquare(from_row, to_col) : to;
+
+  // Remove en passant flags.
+  pawns_ &= ChessBoard::kPawnMask;
+  if (from == kings_[kUs]) reset_castlings(true, true);
+  if (rook_src >= 0) {
+    ours.reset(from);
+    ours.reset(rook_src);
+    rooks_.reset(rook_src);
+    ours.set(king_dst);
+    ours.set(rook_dst);
+    rooks_.set(rook_dst);
+    kings_[kUs] = king_dst;
+  } else {
+    ours.reset(from);
+    ours.set(to);
+    // Remove the captured piece.
+    theirs.reset(captured);
+    rooks_.reset(captured);
+    bishops_.reset(captured);
+    pawns_.reset(captured);
+    if (to_row == kTheirBackRow) {
+      reset_their_castlings(
+          to_col == (kUs == WHITE ? castlings_.their_kingside_rook()
+                                  : castlings_.our_kingside_rook()),
+          to_col == (kUs == WHITE ? castlings_.their_queenside_rook()
+                                  : castlings_.our_queenside_rook()));
+    }
+
+    if (from == kings_[kUs]) {
+      kings_[kUs] = to;
+    } else if (to_row == kPromotionRow && pawns.get(from)) {
+      switch (move.promotion()) {
+        case Move::Promotion::Rook:
+          rooks_.set(to);
+          break;
+        case Move::Promotion::Bishop:
+          bishops_.set(to);
+          break;
+        case Move::Promotion::Queen:
+          rooks_.set(to);
+          bishops_.set(to);
+          break;
+        default:;
+      }
+      pawns_.reset(from);
+    } else {
+      if (from_row == kBackRow && rooks_.get(from)) {
+        reset_castlings(
+            from_col == (kUs == WHITE ? castlings_.our_kingside_rook()
+                                      : castlings_.their_kingside_rook()),
+            from_col == (kUs == WHITE ? castlings_.our_queenside_rook()
+                                      : castlings_.their_queenside_rook()));
+      }
+      rooks_.set_if(to, rooks_.get(from));
+      bishops_.set_if(to, bishops_.get(from));
+      pawns_.set_if(to, pawns_.get(from));
+      rooks_.reset(from);
+      bishops_.reset(from);
+      pawns_.reset(from);
+
+      // Set the en passant flag, only when one of their pawns can take.
+      if (std::abs(to_row - from_row) == 2 && pawns_.get(to)) {
+        const BoardSquare square((from_row + to_row) / 2, to_col);
+        if (PawnAttackers<kThem>(square).intersects(theirs & pawns_)) {
+          pawns_.set(kBackRow, to_col);
+        }
+      }
+    }
+  }
+  side_to_move_ = kThem;
+}
+
+template MoveList ColorBoard::GenerateLegalMoves<WHITE>() const;
+template MoveList ColorBoard::GenerateLegalMoves<BLACK>() const;
+template void ColorBoard::ApplyMove<WHITE>(Move move);
+template void ColorBoard::ApplyMove<BLACK>(Move move);
+
+bool ColorBoard::IsUnderCheck() const {
+  const BitBoard occupied = pieces_[WHITE] | pieces_[BLACK];
+  if (side_to_move_ == WHITE) {
+    return !AttackersTo<BLACK>(kings_[WHITE], occupied).empty();
+  }
+  return !AttackersTo<WHITE>(kings_[BLACK], occupied).empty();
+}
+
+std::string ColorBoard::DebugString() const {
+  std::string result;
+  for (int i = 7; i >= 0; --i) {
+    for (int j = 0; j < 8; ++j) {
+      const BoardSquare square(i, j);
+      if (!pieces_[WHITE].get(square) && !pieces_[BLACK].get(square)) {
+        if ((i == 2 && pawns_.get(0, j)) || (i == 5 && pawns_.get(7, j))) {
+          result += '*';
+        } else {
+          result += '.';
+        }
+        continue;
+      }
+      char c = 'n';
+      if (square == kings_[WHITE] || square == kings_[BLACK]) {
+        c = 'k';
+      } else if ((pawns_ & ChessBoard::kPawnMask).get(square)) {
+        c = 'p';
+      } else if (bishops_.get(square)) {
+        c = rooks_.get(square) ? 'q' : 'b';
+      } else if (rooks_.get(square)) {
+        c = 'r';
+      }
+      if (pieces_[WHITE].get(square)) c = std::toupper(c);
+      result += c;
+    }
+    if (i == 0) {
+      result += " " + castlings_.DebugString();
+      result += side_to_move_ == BLACK ? " (black to move)" : " (white to move)";
+    }
+    result += '\n';
+  }
+  return result;
+}
+
+}  // namespace lczero
@@ -0,0 +1,120 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018-2019 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "board.h"
+
+namespace lczero {
+
+enum Color : uint8_t { WHITE, BLACK };
+
+// Board position kept from white's side whichever side is to move, a perft
+// experiment measuring what never mirroring saves over ChessBoard. Only
+// perft_bench and the board tests build it, nothing searches on it. Moves come
+// and go in absolute coordinates, and generation and move application are
+// templated on the side to move. Unlike ChessBoard it keeps no hash key. En
+// passant flags are kept the same way as in ChessBoard: on rank 1 for a white
+// pawn which can be taken, on rank 8 for a black one.
+class ColorBoard {
+ public:
+  ColorBoard() = default;
+  ColorBoard(const std::string& fen) { SetFromFen(fen); }
+  // Converts from the mirrored representation.
+  explicit ColorBoard(const ChessBoard& board);
+
+  // Sets position from FEN string, same as ChessBoard::SetFromFen().
+  void SetFromFen(std::string fen, int* rule50_ply = nullptr,
+                  int* moves = nullptr);
+
+  // Generates legal moves for @kUs, who has to be the side to move.
+  template <Color kUs>
+  MoveList GenerateLegalMoves() const;
+  // Generates legal moves for the side to move.
+  MoveList GenerateLegalMoves() const {
+    return side_to_move_ == WHITE ? GenerateLegalMoves<WHITE>()
+                                  : GenerateLegalMoves<BLACK>();
+  }
+  // Applies the move of @kUs, who has to be the side to move, and passes the
+  // move to the other side. Castling may be encoded either way.
+  template <Color kUs>
+  void ApplyMove(Move move);
+  void ApplyMove(Move move) {
+    side_to_move_ == WHITE ? ApplyMove<WHITE>(move) : ApplyMove<BLACK>(move);
+  }
+  // Checks if the king of the side to move is under check.
+  bool IsUnderCheck() const;
+
+  std::string DebugString() const;
+
+  Color side_to_move() const { return side_to_move_; }
+
+  bool operator==(const ColorBoard& other) const {
+    return pieces_[WHITE] == other.pieces_[WHITE] &&
+           pieces_[BLACK] == other.pieces_[BLACK] && rooks_ == other.rooks_ &&
+           bishops_ == other.bishops_ && pawns_ == other.pawns_ &&
+           kings_[WHITE] == other.kings_[WHITE] &&
+           kings_[BLACK] == other.kings_[BLACK] &&
+           castlings_ == other.castlings_ &&
+           side_to_move_ == other.side_to_move_;
+  }
+
+ private:
+  BitBoard knights() const {
+    return (pieces_[WHITE] | pieces_[BLACK]) - (pawns_ & ChessBoard::kPawnMask) -
+           kings() - rooks_ - bishops_;
+  }
+  BitBoard kings() const {
+    return kings_[WHITE].as_board() | kings_[BLACK].as_board();
+  }
+  // Returns all squares attacked by @kSide's pieces with the given board
+  // occupancy.
+  template <Color kSide>
+  BitBoard Attacks(BitBoard occupied) const;
+  // Returns the pieces of @kSide attacking @square with the given board
+  // occupancy. Pieces taken off it don't attack.
+  template <Color kSide>
+  BitBoard AttackersTo(BoardSquare square, BitBoard occupied) const;
+
+  // Pieces of each color.
+  BitBoard pieces_[2];
+  // Rooks and queens.
+  BitBoard rooks_;
+  // Bishops and queens.
+  BitBoard bishops_;
+  // Pawns, with the en passant flags on ranks 1 and 8.
+  BitBoard pawns_;
+  BoardSquare kings_[2];
+  // Castlings with "our" meaning white and "their" meaning black.
+  ChessBoard::Castlings castlings_;
+  Color side_to_move_ = WHITE;
+};
+
+}  // namespace lczero
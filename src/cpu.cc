@@ -0,0 +1,92 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018-2019 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "cpu.h"
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include <cstdint>
+
+namespace lczero {
+
+namespace {
+
+CpuFeatures DetectCpuFeatures() {
+  CpuFeatures features;
+#if defined(__x86_64__)
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx)) return features;
+  const unsigned int max_leaf = eax;
+  // "AuthenticAMD", split over ebx, edx and ecx.
+  const bool amd = ebx == 0x68747541 && edx == 0x69746E65 && ecx == 0x444D4163;
+
+  __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+  features.popcnt = ecx & bit_POPCNT;
+  int family = (eax >> 8) & 0xF;
+  if (family == 0xF) family += (eax >> 20) & 0xFF;
+  // AVX registers are only usable if the OS saves them on context switches.
+  bool os_avx = false;
+  bool os_avx512 = false;
+  if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+    uint32_t xcr0_low, xcr0_high;
+    asm("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+    os_avx = (xcr0_low & 0x6) == 0x6;
+    // The opmask and upper halves of the ZMM registers as well.
+    os_avx512 = (xcr0_low & 0xE6) == 0xE6;
+  }
+
+  if (max_leaf >= 7) {
+    __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+    features.bmi2 = ebx & bit_BMI2;
+    features.avx2 = os_avx && (ebx & bit_AVX2);
+    features.avx512 = os_avx512 && (ebx & bit_AVX512F);
+  }
+  // Zen 3 is family 19h.
+  features.fast_pext = features.bmi2 && !(amd && family < 0x19);
+#endif
+  return features;
+}
+
+}  // namespace
+
+std::string CpuFeatures::DebugString() const {
+  std::string result;
+  if (popcnt) result += " popcnt";
+  if (bmi2) result += fast_pext ? " bmi2" : " bmi2(slow pext)";
+  if (avx2) result += " avx2";
+  if (avx512) result += " avx512";
+  return result.empty() ? "none" : result.substr(1);
+}
+
+const CpuFeatures& GetCpuFeatures() {
+  static const CpuFeatures features = DetectCpuFeatures();
+  return features;
+}
+
+}  // namespace lczero
@@ -0,0 +1,58 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018-2019 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <string>
+
+namespace lczero {
+
+// Instruction set extensions of the CPU the engine runs on. The binary is
+// built for the baseline of its architecture; code using anything newer checks
+// these first.
+struct CpuFeatures {
+  bool popcnt = false;
+  bool bmi2 = false;
+  bool avx2 = false;
+  // AVX-512 Foundation, the 512-bit registers and 64-bit lane operations.
+  bool avx512 = false;
+  // pext and pdep are microcoded, and slower than magic multiplication, on AMD
+  // CPUs before Zen 3.
+  bool fast_pext = false;
+
+  // Lists the detected features, e.g. "popcnt bmi2 avx2 avx512".
+  std::string DebugString() const;
+};
+
+// Returns the features of this CPU, queried with cpuid on first use.
+const CpuFeatures& GetCpuFeatures();
+
+// Whether popcnt may be used. Static initialization sets it; code running
+// before that takes the portable path.
+inline const bool kCpuHasPopcnt = GetCpuFeatures().popcnt;
+
+}  // namespace lczero
@@ -0,0 +1,347 @@
+// Times the building blocks of the board and position code over a fixed set
+// of positions, to catch regressions between commits. Each benchmark is run
+// for a number of samples; the ns per operation of each sample give the mean,
+// standard deviation and minimum reported.
+//
+// Usage: whisperchess_microbench [options]
+//   --json           Prints the results as JSON, e.g. to diff two runs.
+//   --samples=N      Number of samples per benchmark (default 15).
+//   --filter=TEXT    Only runs the benchmarks whose name contains TEXT.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "batch_attacks.h"
+#include "board.h"
+#include "position.h"
+#include "piece_squares.hpp"
+
+using namespace lczero;
+
+namespace {
+
+// Openings, middlegames with checks, pins, castling and en passant,
+// endgames and Chess960 positions.
+const char* const kFens[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4",
+    "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+    "r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1",
+    "8/8/3k4/3p4/8/3P4/3K4/8 w - - 0 1",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+    "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9",
+};
+
+// Position of the corpus with what the benchmarks need prepared.
+struct CorpusEntry {
+  std::string fen;
+  ChessBoard board;
+  MoveList moves;
+};
+
+struct Result {
+  std::string name;
+  int samples;
+  uint64_t ops_per_sample;
+  double mean_ns;
+  double stddev_ns;
+  double min_ns;
+};
+
+// Results are summed in here so the compiler can't drop the work.
+volatile uint64_t sink;
+
+// Runs @body, which makes a pass over the corpus and returns the number of
+// operations it did, until a sample takes at least this long.
+constexpr std::chrono::milliseconds kMinSampleTime(20);
+
+Result Measure(const std::string& name, int samples,
+               const std::function<uint64_t()>& body) {
+  // Warms up and finds how many passes a sample needs.
+  uint64_t passes = 1;
+  for (;;) {
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < passes; i++) body();
+    if (std::chrono::steady_clock::now() - start >= kMinSampleTime) break;
+    passes *= 2;
+  }
+
+  std::vector<double> ns_per_op;
+  uint64_t ops = 0;
+  for (int sample = 0; sample < samples; sample++) {
+    ops = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < passes; i++) ops += body();
+    const std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    ns_per_op.push_back(elapsed.count() / ops);
+  }
+
+  Result result{name, samples, ops, 0, 0, 0};
+  for (double x : ns_per_op) result.mean_ns += x;
+  result.mean_ns /= samples;
+  for (double x : ns_per_op) {
+    result.stddev_ns += (x - result.mean_ns) * (x - result.mean_ns);
+  }
+  result.stddev_ns =
+      samples > 1 ? std::sqrt(result.stddev_ns / (samples - 1)) : 0;
+  result.min_ns = *std::min_element(ns_per_op.begin(), ns_per_op.end());
+  return result;
+}
+
+// @body makes a pass over the corpus and returns the number of operations it
+// did. @setup, if set, runs once before the benchmark is measured and
+// @teardown once after, both untimed.
+struct Benchmark {
+  std::string name;
+  std::function<uint64_t()> body;
+  std::function<void()> setup = nullptr;
+  std::function<void()> teardown = nullptr;
+};
+
+std::vector<Benchmark> Benchmarks(
+    const std::vector<CorpusEntry>& corpus) {
+  std::vector<Benchmark> benchmarks;
+  // Per position.
+  benchmarks.emplace_back("ChessBoard::GeneratePseudolegalMoves", [&] {
+    uint64_t sum = 0;
+    for (const auto& entry : corpus) {
+      sum += entry.board.GeneratePseudolegalMoves().size();
+    }
+    sink = sink + sum;
+    return corpus.size();
+  });
+  benchmarks.emplace_back("ChessBoard::GenerateLegalMoves", [&] {
+    uint64_t sum = 0;
+    for (const auto& entry : corpus) {
+      sum += entry.board.GenerateLegalMoves().size();
+    }
+    sink = sink + sum;
+    return corpus.size();
+  });
+  // Per move, including the board copy.
+  benchmarks.emplace_back("ChessBoard::ApplyMove", [&] {
+    uint64_t sum = 0;
+    uint64_t ops = 0;
+    for (const auto& entry : corpus) {
+      for (auto move : entry.moves) {
+        ChessBoard board = entry.board;
+        sum += board.ApplyMove(move);
+        sum += board.Hash();
+      }
+      ops += entry.moves.size();
+    }
+    sink = sink + sum;
+    return ops;
+  });
+  // Per position, including the board copy.
+  benchmarks.emplace_back("ChessBoard::Mirror", [&] {
+    uint64_t sum = 0;
+    for (const auto& entry : corpus) {
+      ChessBoard board = entry.board;
+      board.Mirror();
+      sum += board.ours().as_int();
+    }
+    sink = sink + sum;
+    return corpus.size();
+  });
+  benchmarks.emplace_back("ChessBoard::Hash", [&] {
+    uint64_t sum = 0;
+    for (const auto& entry : corpus) sum += entry.board.Hash();
+    sink = sink + sum;
+    return corpus.size();
+  });
+  benchmarks.emplace_back("ChessBoard::ComputeHash", [&] {
+    uint64_t sum = 0;
+    for (const auto& entry : corpus) sum += entry.board.ComputeHash();
+    sink = sink + sum;
+    return corpus.size();
+  });
+  // Per square.
+  benchmarks.emplace_back("ChessBoard::IsUnderAttack", [&] {
+    uint64_t sum = 0;
+    for (const auto& entry : corpus) {
+      for (int square = 0; square < 64; square++) {
+        sum += entry.board.IsUnderAttack(BoardSquare(square));
+      }
+    }
+    sink = sink + sum;
+    return corpus.size() * 64;
+  });
+  benchmarks.emplace_back("ChessBoard::GenerateKingAttackInfo", [&] {
+    uint64_t sum = 0;
+    for (const auto& entry : corpus) {
+      const KingAttackInfo info = entry.board.GenerateKingAttackInfo();
+      sum += info.pinned_pieces_.as_int() + info.attack_lines_.as_int();
+    }
+    sink = sink + sum;
+    return corpus.size();
+  });
+  benchmarks.emplace_back("score_position_with_piece_squares", [&] {
+    uint64_t sum = 0;
+    for (const auto& entry : corpus) {
+      sum += score_position_with_piece_squares(Position(entry.board, 0, 0));
+    }
+    sink = sink + sum;
+    return corpus.size();
+  });
+  benchmarks.emplace_back("ChessBoard::SetFromFen", [&] {
+    uint64_t sum = 0;
+    for (const auto& entry : corpus) {
+      ChessBoard board;
+      board.SetFromFen(entry.fen);
+      sum += board.Hash();
+    }
+    sink = sink + sum;
+    return corpus.size();
+  });
+  benchmarks.emplace_back("GetFen", [&] {
+    uint64_t sum = 0;
+    for (const auto& entry : corpus) {
+      sum += GetFen(Position(entry.board, 0, 0)).size();
+    }
+    sink = sink + sum;
+    return corpus.size();
+  });
+  // Per move, an Append() and the Pop() taking it back.
+  benchmarks.emplace_back("PositionHistory::Append", [&] {
+    uint64_t sum = 0;
+    uint64_t ops = 0;
+    PositionHistory history;
+    for (const auto& entry : corpus) {
+      history.Reset(entry.board, 0, 0);
+      for (auto move : entry.moves) {
+        history.Append(move);
+        sum += history.Last().GetRepetitions();
+        history.Pop();
+      }
+      ops += entry.moves.size();
+    }
+    sink = sink + sum;
+    return ops;
+  });
+  // Per board, over the positions after each move of the corpus: the batched
+  // attacks with each backend, against GetAttackMap() one board at a time.
+  std::vector<ChessBoard> children;
+  for (const auto& entry : corpus) {
+    for (auto move : entry.moves) {
+      ChessBoard child = entry.board;
+      child.ApplyMove(move);
+      child.Mirror();
+      children.push_back(child);
+    }
+  }
+  benchmarks.emplace_back("ChessBoard::GetAttackMap", [children] {
+    uint64_t sum = 0;
+    for (const auto& board : children) {
+      sum += board.GetAttackMap().all().count();
+    }
+    sink = sink + sum;
+    return children.size();
+  });
+  // Each backend is selected before its benchmark, and the default one
+  // restored after.
+  const BatchBackend default_backend = GetBatchBackend();
+  for (auto backend : {BatchBackend::kScalar, BatchBackend::kAvx2,
+                       BatchBackend::kAvx512}) {
+    if (!IsBatchBackendSupported(backend)) continue;
+    benchmarks.emplace_back(
+        std::string("ComputeBatchAttacks/") + BatchBackendName(backend),
+        [children, attacks = BatchAttacks()]() mutable {
+          ComputeBatchAttacks(children.data(), children.size(), &attacks);
+          uint64_t sum = 0;
+          for (auto count : attacks.count) sum += count;
+          sink = sink + sum;
+          return children.size();
+        },
+        [backend] { SetBatchBackend(backend); },
+        [default_backend] { SetBatchBackend(default_backend); });
+  }
+  return benchmarks;
+}
+
+void PrintText(const std::vector<Result>& results) {
+  std::printf("%s\n", BackendsDebugString().c_str());
+  std::printf("%-40s %12s %10s %10s %8s\n", "benchmark", "ns/op", "stddev",
+              "min", "samples");
+  for (const auto& result : results) {
+    std::printf("%-40s %12.2f %10.2f %10.2f %8d\n", result.name.c_str(),
+                result.mean_ns, result.stddev_ns, result.min_ns,
+                result.samples);
+  }
+}
+
+void PrintJson(const std::vector<Result>& results) {
+  std::printf("{\n  \"backends\": \"%s\",\n  \"benchmarks\": [\n",
+              BackendsDebugString().c_str());
+  for (size_t i = 0; i < results.size(); i++) {
+    const auto& result = results[i];
+    std::printf(
+        "    {\"name\": \"%s\", \"ns_per_op\": %.3f, \"stddev_ns\": %.3f, "
+        "\"min_ns\": %.3f, \"samples\": %d, \"ops_per_sample\": %llu}%s\n",
+        result.name.c_str(), result.mean_ns, result.stddev_ns, result.min_ns,
+        result.samples, static_cast<unsigned long long>(result.ops_per_sample),
+        i + 1 < results.size() ? "," : "");
+  }
+  std::printf("  ]\n}\n");
+}
+
+int Usage() {
+  std::fprintf(stderr,
+               "Usage: whisperchess_microbench [--json] [--samples=N] "
+               "[--filter=TEXT]\n");
+  return 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bool json = false;
+  int samples = 15;
+  std::string filter;
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    if (argument == "--json") {
+      json = true;
+    } else if (argument.rfind("--samples=", 0) == 0) {
+      samples = std::max(1, std::atoi(argument.c_str() + 10));
+    } else if (argument.rfind("--filter=", 0) == 0) {
+      filter = argument.substr(9);
+    } else {
+      return Usage();
+    }
+  }
+
+  std::vector<CorpusEntry> corpus;
+  for (const char* fen : kFens) {
+    CorpusEntry entry{fen, ChessBoard(fen), {}};
+    entry.moves = entry.board.GenerateLegalMoves();
+    corpus.push_back(entry);
+  }
+
+  std::vector<Result> results;
+  for (const auto& benchmark : Benchmarks(corpus)) {
+    if (benchmark.name.find(filter) == std::string::npos) continue;
+    if (benchmark.setup) benchmark.setup();
+    results.push_back(Measure(benchmark.name, samples, benchmark.body));
+    if (benchmark.teardown) benchmark.teardown();
+  }
+  if (json) {
+    PrintJson(results);
+  } else {
+    PrintText(results);
+  }
+  return 0;
+}
@@ -0,0 +1,211 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018-2019 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "move_picker.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+
+namespace lczero {
+
+namespace {
+enum PieceOrder { kNoPiece, kPawn, kKnight, kBishop, kRook, kQueen, kKing };
+
+PieceOrder PieceOn(const ChessBoard& board, BoardSquare square) {
+  if (board.pawns().get(square)) return kPawn;
+  if (board.knights().get(square)) return kKnight;
+  if (board.bishops().get(square)) return kBishop;
+  if (board.rooks().get(square)) return kRook;
+  if (board.queens().get(square)) return kQueen;
+  if (board.kings().get(square)) return kKing;
+  return kNoPiece;
+}
+
+// Values as in SEE(), to settle most captures without running it.
+constexpr int kPieceValue[] = {0, 100, 300, 300, 500, 900, 0};
+
+// Whether @move is a capture, en passant included, or a queen promotion: the
+// moves of GenerateCaptures().
+bool IsCaptureOrPromotion(const ChessBoard& board, Move move) {
+  if (board.theirs().get(move.to())) return true;
+  if (move.promotion() == Move::Promotion::Queen) return true;
+  return board.pawns().get(move.from()) && move.from().col() != move.to().col();
+}
+}  // namespace
+
+void MoveOrdering::Clear() {
+  std::fill(&killers_[0][0], &killers_[0][0] + kMaxPly * 2, Move());
+  std::fill(&history_[0][0], &history_[0][0] + 64 * 64, 0);
+}
+
+void MoveOrdering::NewSearch() {
+  std::fill(&killers_[0][0], &killers_[0][0] + kMaxPly * 2, Move());
+  for (auto& row : history_) {
+    for (auto& entry : row) entry /= 2;
+  }
+}
+
+void MoveOrdering::UpdateHistory(Move move, int bonus) {
+  // Moves towards +-kMaxHistory by less the closer it is.
+  int16_t& entry = history_[move.from().as_int()][move.to().as_int()];
+  entry += bonus - entry * std::abs(bonus) / kMaxHistory;
+}
+
+void MoveOrdering::UpdateQuietCutoff(int ply, int depth, Move move,
+                                     const MoveList& tried) {
+  if (ply < kMaxPly && !(killers_[ply][0] == move)) {
+    killers_[ply][1] = killers_[ply][0];
+    killers_[ply][0] = move;
+  }
+  const int bonus = std::min(depth * depth, 400);
+  UpdateHistory(move, bonus);
+  for (auto other : tried) UpdateHistory(other, -bonus);
+}
+
+MovePicker::MovePicker(const ChessBoard& board, Move tt_move,
+                       const MoveOrdering& ordering, int ply)
+    : board_(board), ordering_(&ordering), ply_(ply) {
+  if (tt_move && board.IsLegal(tt_move)) tt_move_ = tt_move;
+}
+
+MovePicker::MovePicker(const ChessBoard& board)
+    : board_(board), ordering_(nullptr), ply_(0) {}
+
+bool MovePicker::IsEarlyMove(Move move) const {
+  if (tt_move_ == move) return true;
+  for (int i = 0; i < num_killers_; i++) {
+    if (killers_[i] == move) return true;
+  }
+  return false;
+}
+
+Move MovePicker::PickBest() {
+  size_t best = next_;
+  for (size_t i = next_ + 1; i < moves_.size(); i++) {
+    if (scores_[i] > scores_[best]) best = i;
+  }
+  std::swap(moves_[next_], moves_[best]);
+  std::swap(scores_[next_], scores_[best]);
+  return moves_[next_++];
+}
+
+Move MovePicker::Next() {
+  switch (stage_) {
+    case Stage::kTTMove:
+      stage_ = Stage::kGenerateCaptures;
+      if (tt_move_) {
+        last_is_quiet_ = !IsCaptureOrPromotion(board_, tt_move_);
+        return tt_move_;
+      }
+      [[fallthrough]];
+
+    case Stage::kGenerateCaptures:
+      moves_ = board_.GenerateCaptures();
+      for (size_t i = 0; i < moves_.size(); i++) {
+        const Move move = moves_[i];
+        // En passant captures a pawn from an empty square.
+        const int victim = std::max<int>(PieceOn(board_, move.to()), kPawn);
+        const int promotion =
+            move.promotion() == Move::Promotion::Queen ? kQueen : 0;
+        scores_[i] = (victim + promotion) * 8 - PieceOn(board_, move.from());
+      }
+      next_ = 0;
+      stage_ = Stage::kWinningCaptures;
+      [[fallthrough]];
+
+    case Stage::kWinningCaptures:
+      last_is_quiet_ = false;
+      while (next_ < moves_.size()) {
+        const Move move = PickBest();
+        if (move == tt_move_) continue;
+        const PieceOrder attacker = PieceOn(board_, move.from());
+        // The king only captures undefended pieces, and taking a piece
+        // worth at least the attacker wins whatever the recapture.
+        if (attacker == kKing ||
+            (move.promotion() == Move::Promotion::None &&
+             kPieceValue[PieceOn(board_, move.to())] >=
+                 kPieceValue[attacker]) ||
+            board_.SEEGreaterOrEqual(move, 0)) {
+          return move;
+        }
+        losing_captures_.push_back(move);
+      }
+      if (!ordering_) {
+        stage_ = Stage::kDone;
+        break;
+      }
+      for (int i = 0; i < 2; i++) {
+        const Move killer = ordering_->killer(ply_, i);
+        if (killer && !(killer == tt_move_) && board_.IsLegal(killer) &&
+            !IsCaptureOrPromotion(board_, killer)) {
+          killers_[num_killers_++] = killer;
+        }
+      }
+      stage_ = Stage::kKillers;
+      [[fallthrough]];
+
+    case Stage::kKillers:
+      last_is_quiet_ = true;
+      if (killer_index_ < num_killers_) return killers_[killer_index_++];
+      stage_ = Stage::kGenerateQuiets;
+      [[fallthrough]];
+
+    case Stage::kGenerateQuiets:
+      moves_ = board_.GenerateQuiets();
+      for (size_t i = 0; i < moves_.size(); i++) {
+        scores_[i] = ordering_->history(moves_[i]);
+      }
+      next_ = 0;
+      stage_ = Stage::kQuiets;
+      [[fallthrough]];
+
+    case Stage::kQuiets:
+      while (next_ < moves_.size()) {
+        const Move move = PickBest();
+        if (IsEarlyMove(move)) continue;
+        // Underpromotions may capture.
+        last_is_quiet_ = !IsCaptureOrPromotion(board_, move);
+        return move;
+      }
+      next_ = 0;
+      stage_ = Stage::kLosingCaptures;
+      [[fallthrough]];
+
+    case Stage::kLosingCaptures:
+      last_is_quiet_ = false;
+      if (next_ < losing_captures_.size()) return losing_captures_[next_++];
+      stage_ = Stage::kDone;
+      [[fallthrough]];
+
+    case Stage::kDone:
+      break;
+  }
+  return Move();
+}
+
+}  // namespace lczero
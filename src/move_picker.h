@@ -0,0 +1,130 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018-2019 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "board.h"
+
+namespace lczero {
+
+// Quiet moves which caused beta cutoffs, kept across the nodes of a search to
+// try them early in the nodes that follow: the last two killers of each ply
+// from the root, and a butterfly history of all plies indexed by the from and
+// to squares.
+class MoveOrdering {
+ public:
+  static constexpr int kMaxPly = 128;
+  // History scores stay within +-kMaxHistory.
+  static constexpr int kMaxHistory = 1 << 14;
+
+  MoveOrdering() { Clear(); }
+
+  // Forgets everything, e.g. for a new game.
+  void Clear();
+  // Starts a new search: drops the killers, whose plies no longer match, and
+  // halves the history.
+  void NewSearch();
+
+  Move killer(int ply, int index) const {
+    return ply < kMaxPly ? killers_[ply][index] : Move();
+  }
+  int history(Move move) const {
+    return history_[move.from().as_int()][move.to().as_int()];
+  }
+
+  // Records that quiet @move failed high at @ply with @depth plies left,
+  // after the quiet moves @tried failed low.
+  void UpdateQuietCutoff(int ply, int depth, Move move, const MoveList& tried);
+
+ private:
+  void UpdateHistory(Move move, int bonus);
+
+  Move killers_[kMaxPly][2];
+  int16_t history_[64][64];
+};
+
+// Returns the legal moves of a position one at a time, in stages, generating
+// and scoring the moves of each stage only once it is reached, since a cutoff
+// often comes before the later ones:
+// 1. the hash move, if legal;
+// 2. captures and queen promotions not losing material by SEE, most valuable
+//    victim first, then least valuable attacker;
+// 3. the killers of the ply, if legal quiet moves;
+// 4. the other quiet moves by history;
+// 5. the captures losing material, in the order of stage 2.
+// Each legal move is returned exactly once.
+class MovePicker {
+ public:
+  MovePicker(const ChessBoard& board, Move tt_move,
+             const MoveOrdering& ordering, int ply);
+  // Returns only the moves of stage 2, for the quiescence search.
+  explicit MovePicker(const ChessBoard& board);
+
+  // Returns the next move, or an empty move once all have been returned.
+  Move Next();
+  // Whether the move last returned is quiet, i.e. neither a capture nor a
+  // queen promotion.
+  bool last_is_quiet() const { return last_is_quiet_; }
+
+ private:
+  enum class Stage : uint8_t {
+    kTTMove,
+    kGenerateCaptures,
+    kWinningCaptures,
+    kKillers,
+    kGenerateQuiets,
+    kQuiets,
+    kLosingCaptures,
+    kDone,
+  };
+
+  // Whether @move is one of the moves already returned before stage 4.
+  bool IsEarlyMove(Move move) const;
+  // Moves the best scored of moves_[next_..] to next_ and returns it.
+  Move PickBest();
+
+  const ChessBoard& board_;
+  // Null when only captures are returned.
+  const MoveOrdering* const ordering_;
+  const int ply_;
+  Stage stage_ = Stage::kTTMove;
+  bool last_is_quiet_ = false;
+  Move tt_move_;
+  Move killers_[2];
+  int num_killers_ = 0;
+  int killer_index_ = 0;
+
+  MoveList moves_;
+  int scores_[MoveList::kMaxMoves];
+  size_t next_ = 0;
+  MoveList losing_captures_;
+};
+
+}  // namespace lczero
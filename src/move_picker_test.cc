@@ -0,0 +1,144 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018-2019 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "move_picker.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace lczero {
+
+namespace {
+std::vector<Move> PickAll(const ChessBoard& board, Move tt_move,
+                          const MoveOrdering& ordering, int ply) {
+  std::vector<Move> moves;
+  MovePicker picker(board, tt_move, ordering, ply);
+  for (Move move = picker.Next(); move; move = picker.Next()) {
+    moves.push_back(move);
+  }
+  return moves;
+}
+
+// Checks that every legal move is picked exactly once, whichever of them or
+// of another position's moves are the hash move and the killers.
+void CheckPicksLegalMoves(const ChessBoard& board, const MoveList& foreign) {
+  MoveList legal = board.GenerateLegalMoves();
+  std::vector<Move> candidates(legal.begin(), legal.end());
+  candidates.insert(candidates.end(), foreign.begin(), foreign.end());
+  candidates.push_back(Move());
+  auto key = [](Move move) { return move.as_packed_int(); };
+  auto sorted = [&](std::vector<Move> moves) {
+    std::sort(moves.begin(), moves.end(),
+              [&](Move a, Move b) { return key(a) < key(b); });
+    return moves;
+  };
+  const std::vector<Move> expected =
+      sorted(std::vector<Move>(legal.begin(), legal.end()));
+  for (size_t i = 0; i < candidates.size(); i++) {
+    MoveOrdering ordering;
+    const Move tt_move = candidates[i];
+    ordering.UpdateQuietCutoff(3, 1, candidates[(i + 1) % candidates.size()],
+                               {});
+    ordering.UpdateQuietCutoff(3, 1, candidates[(i + 2) % candidates.size()],
+                               {});
+    const std::vector<Move> picked = PickAll(board, tt_move, ordering, 3);
+    EXPECT_EQ(sorted(picked), expected) << board.DebugString();
+    if (tt_move && board.IsLegal(tt_move)) {
+      ASSERT_FALSE(picked.empty());
+      EXPECT_EQ(picked[0], tt_move);
+    }
+  }
+}
+}  // namespace
+
+TEST(MovePicker, PicksLegalMovesOnce) {
+  ChessBoard other(
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1");
+  const MoveList foreign = other.GenerateLegalMoves();
+  for (const char* fen : {
+           ChessBoard::kStartposFen,
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - "
+           "0 1",
+           "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+           "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+           "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+           // In check.
+           "r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1",
+       }) {
+    CheckPicksLegalMoves(ChessBoard(fen), foreign);
+  }
+}
+
+TEST(MovePicker, Stages) {
+  // The knight on e5 can take the queen on d7, or the pawn on f7 defended by
+  // the king; the queen can take the rook on h8.
+  ChessBoard board("4k1nr/3q1p2/8/4N3/8/8/8/4K2Q w - - 0 1");
+  MoveOrdering ordering;
+  const MoveList no_moves;
+  ordering.UpdateQuietCutoff(0, 1, Move("e1f1"), no_moves);
+  ordering.UpdateQuietCutoff(0, 1, Move("e1e2"), no_moves);
+  // Quiets are ordered by history.
+  ordering.UpdateQuietCutoff(1, 4, Move("h1h2"), no_moves);
+  const std::vector<Move> picked = PickAll(board, Move("e5c6"), ordering, 0);
+  ASSERT_GE(picked.size(), 7u);
+  EXPECT_EQ(picked[0], Move("e5c6"));
+  // Most valuable victim first.
+  EXPECT_EQ(picked[1], Move("e5d7"));
+  EXPECT_EQ(picked[2], Move("h1h8"));
+  // Last killer first.
+  EXPECT_EQ(picked[3], Move("e1e2"));
+  EXPECT_EQ(picked[4], Move("e1f1"));
+  EXPECT_EQ(picked[5], Move("h1h2"));
+  // The capture losing the knight comes last.
+  EXPECT_EQ(picked.back(), Move("e5f7"));
+}
+
+TEST(MovePicker, UnderpromotionCapturesAreNotQuiet) {
+  ChessBoard board("1n2k3/P7/8/8/8/8/8/4K3 w - - 0 1");
+  MoveOrdering ordering;
+  MovePicker picker(board, Move(), ordering, 0);
+  int num_moves = 0;
+  for (Move move = picker.Next(); move; move = picker.Next()) {
+    const bool quiet = !board.theirs().get(move.to()) &&
+                       move.promotion() != Move::Promotion::Queen;
+    EXPECT_EQ(picker.last_is_quiet(), quiet) << move.as_string();
+    num_moves++;
+  }
+  // Eight promotions and five king moves.
+  EXPECT_EQ(num_moves, 13);
+}
+
+TEST(MovePicker, CapturesOnly) {
+  // As in Stages, without the quiets and the capture losing the knight.
+  ChessBoard board("4k1nr/3q1p2/8/4N3/8/8/8/4K2Q w - - 0 1");
+  std::vector<Move> picked;
+  MovePicker picker(board);
+  for (Move move = picker.Next(); move; move = picker.Next()) {
+    picked.push_back(move);
+  }
+  EXPECT_EQ(picked, (std::vector<Move>{Move("e5d7"), Move("h1h8")}));
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,263 @@
+// Counts the leaf nodes of the legal move tree of a position, the throughput
+// yardstick for move generator changes.
+//
+// Usage: whisperchess_perft [options] <fen | epd file | startpos> <depth>
+//   --divide     Prints the node count below each root move.
+//   --bulk       Counts the legal moves at depth 1 instead of visiting them.
+//   --threads=N  Splits the root moves across N threads.
+//   --hash=MB    Shares a perft transposition table of MB megabytes between
+//                the threads.
+//
+// EPD files hold a position per line, optionally followed by expected counts:
+//   <fen> ;D1 20 ;D2 400 ;D3 8902
+// A count given for the requested depth is checked.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "board.h"
+#include "exception.h"
+
+using namespace lczero;
+
+namespace {
+
+struct Options {
+  bool divide = false;
+  bool bulk = false;
+  int threads = 1;
+  size_t hash_mb = 0;
+};
+
+// Node counts of (position, depth) pairs, shared between threads without
+// locks. An entry stores its key xor its data, so a torn write from two
+// threads fails the key check instead of returning a wrong count.
+class PerftTable {
+ public:
+  explicit PerftTable(size_t megabytes) {
+    size_t size = 1;
+    while (size * 2 * sizeof(Entry) <= megabytes << 20) size *= 2;
+    entries_ = std::make_unique<Entry[]>(size);
+    mask_ = size - 1;
+  }
+
+  bool Probe(uint64_t key, int depth, uint64_t* nodes) const {
+    key = DepthKey(key, depth);
+    const Entry& entry = entries_[key & mask_];
+    const uint64_t data = entry.data.load(std::memory_order_relaxed);
+    if ((entry.check.load(std::memory_order_relaxed) ^ data) != key) {
+      return false;
+    }
+    *nodes = data;
+    return true;
+  }
+
+  void Store(uint64_t key, int depth, uint64_t nodes) {
+    key = DepthKey(key, depth);
+    Entry& entry = entries_[key & mask_];
+    entry.check.store(key ^ nodes, std::memory_order_relaxed);
+    entry.data.store(nodes, std::memory_order_relaxed);
+  }
+
+ private:
+  struct Entry {
+    std::atomic<uint64_t> check{0};
+    std::atomic<uint64_t> data{0};
+  };
+
+  // Mixes the remaining depth into the position key, so the counts of a
+  // position at different depths land in different entries.
+  static uint64_t DepthKey(uint64_t key, int depth) {
+    return key ^ (depth * 0x9E3779B97F4A7C15ULL);
+  }
+
+  std::unique_ptr<Entry[]> entries_;
+  uint64_t mask_;
+};
+
+uint64_t Perft(const ChessBoard& board, int depth, const Options& options,
+               PerftTable* table) {
+  if (depth == 0) return 1;
+  uint64_t nodes = 0;
+  if (table && depth > 1 && table->Probe(board.Hash(), depth, &nodes)) {
+    return nodes;
+  }
+  const MoveList moves = board.GenerateLegalMoves();
+  if (options.bulk && depth == 1) return moves.size();
+  for (auto move : moves) {
+    auto new_board = board;
+    new_board.ApplyMove(move);
+    new_board.Mirror();
+    nodes += Perft(new_board, depth - 1, options, table);
+  }
+  if (table && depth > 1) table->Store(board.Hash(), depth, nodes);
+  return nodes;
+}
+
+// Runs perft below each root move, with the root moves split across the
+// threads. Returns the counts in the order of GenerateLegalMoves().
+std::vector<uint64_t> PerftRootMoves(const ChessBoard& board, int depth,
+                                     const Options& options,
+                                     PerftTable* table) {
+  const MoveList moves = board.GenerateLegalMoves();
+  std::vector<uint64_t> counts(moves.size());
+  std::atomic<size_t> next_move{0};
+  auto worker = [&]() {
+    for (size_t i = next_move++; i < moves.size(); i = next_move++) {
+      auto new_board = board;
+      new_board.ApplyMove(moves[i]);
+      new_board.Mirror();
+      counts[i] = Perft(new_board, depth - 1, options, table);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < options.threads; i++) threads.emplace_back(worker);
+  worker();
+  for (auto& thread : threads) thread.join();
+  return counts;
+}
+
+// Runs perft on @fen and prints the result. Returns the node count.
+uint64_t RunPosition(const std::string& fen, int depth, const Options& options,
+                     PerftTable* table) {
+  const ChessBoard board(fen);
+  std::printf("Position: %s\n", fen.c_str());
+  const auto start = std::chrono::steady_clock::now();
+  uint64_t nodes = 1;
+  if (depth > 0) {
+    const auto counts = PerftRootMoves(board, depth, options, table);
+    const MoveList moves = board.GenerateLegalMoves();
+    nodes = 0;
+    for (size_t i = 0; i < moves.size(); i++) {
+      nodes += counts[i];
+      if (!options.divide) continue;
+      Move move = board.GetLegacyMove(moves[i]);
+      if (board.flipped()) move.Mirror();
+      std::printf("%s: %llu\n", move.as_string().c_str(),
+                  static_cast<unsigned long long>(counts[i]));
+    }
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::printf("Nodes: %llu  time: %.3f s  nps: %.0f\n",
+              static_cast<unsigned long long>(nodes), elapsed.count(),
+              nodes / std::max(elapsed.count(), 1e-9));
+  return nodes;
+}
+
+// A position of an EPD file and its expected count at @depth, or -1.
+struct EpdPosition {
+  std::string fen;
+  int64_t expected = -1;
+};
+
+std::vector<EpdPosition> ReadEpd(std::ifstream& file, int depth) {
+  std::vector<EpdPosition> positions;
+  const std::string depth_tag = "D" + std::to_string(depth);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    EpdPosition position;
+    std::getline(fields, position.fen, ';');
+    const size_t end = position.fen.find_last_not_of(" \t\r");
+    if (end == std::string::npos) continue;
+    position.fen.erase(end + 1);
+    std::string field;
+    while (std::getline(fields, field, ';')) {
+      std::istringstream count(field);
+      std::string tag;
+      count >> tag;
+      if (tag == depth_tag) count >> position.expected;
+    }
+    positions.push_back(position);
+  }
+  return positions;
+}
+
+int Usage() {
+  std::fprintf(stderr,
+               "Usage: whisperchess_perft [--divide] [--bulk] [--threads=N] "
+               "[--hash=MB] <fen | epd file | startpos> <depth>\n");
+  return 1;
+}
+
+int Main(int argc, char** argv) {
+  Options options;
+  std::vector<std::string> arguments;
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    if (argument == "--divide") {
+      options.divide = true;
+    } else if (argument == "--bulk") {
+      options.bulk = true;
+    } else if (argument.rfind("--threads=", 0) == 0) {
+      options.threads = std::max(1, std::atoi(argument.c_str() + 10));
+    } else if (argument.rfind("--hash=", 0) == 0) {
+      options.hash_mb = std::atoll(argument.c_str() + 7);
+    } else if (argument.rfind("--", 0) == 0) {
+      return Usage();
+    } else {
+      arguments.push_back(argument);
+    }
+  }
+  if (arguments.size() != 2) return Usage();
+  const int depth = std::atoi(arguments[1].c_str());
+  if (depth < 0) return Usage();
+
+  std::unique_ptr<PerftTable> table;
+  if (options.hash_mb > 0) {
+    table = std::make_unique<PerftTable>(options.hash_mb);
+  }
+  std::printf("%s, %d thread(s)%s\n", BackendsDebugString().c_str(),
+              options.threads, table ? ", hash" : "");
+
+  std::ifstream file(arguments[0]);
+  if (!file) {
+    const std::string fen = arguments[0] == "startpos"
+                                ? ChessBoard::kStartposFen
+                                : arguments[0];
+    RunPosition(fen, depth, options, table.get());
+    return 0;
+  }
+
+  int failures = 0;
+  uint64_t total_nodes = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto& position : ReadEpd(file, depth)) {
+    const uint64_t nodes =
+        RunPosition(position.fen, depth, options, table.get());
+    total_nodes += nodes;
+    if (position.expected >= 0 &&
+        nodes != static_cast<uint64_t>(position.expected)) {
+      std::printf("MISMATCH: expected %lld\n",
+                  static_cast<long long>(position.expected));
+      failures++;
+    }
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::printf("Total nodes: %llu  time: %.3f s  nps: %.0f  mismatches: %d\n",
+              static_cast<unsigned long long>(total_nodes), elapsed.count(),
+              total_nodes / std::max(elapsed.count(), 1e-9), failures);
+  return failures ? 1 : 0;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  try {
+    return Main(argc, argv);
+  } catch (const Exception& exception) {
+    std::fprintf(stderr, "Error: %s\n", exception.what());
+    return 1;
+  }
+}
@@ -0,0 +1,219 @@
+// Compares perft node rates of copy-make (copy the board, ApplyMove() and
+// Mirror() the copy) against make/unmake (DoMove() and UndoMove() on a single
+// board) and against copy-make on a ColorBoard, which never mirrors but unlike
+// ChessBoard keeps no hash key, with every slider attack backend this CPU
+// supports. Also times GivesCheck() against applying each move and testing
+// IsUnderCheck(), and times what a search does at each node of king-heavy
+// endgames: generating the legal moves, testing for check and counting the
+// mobility.
+// Usage: whisperchess_perft_bench [depth adjustment]
+//
+// The _compressed build uses 16-bit pext/pdep tables (COMPRESSED_PEXT) for the
+// pext backend. Run it under "perf stat -e l2_rqsts.miss" to compare cache
+// misses too.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "board.h"
+#include "color_board.h"
+
+using namespace lczero;
+
+namespace {
+
+const struct {
+  const char* const fen;
+  int depth;
+} kPositions[] = {
+    {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5},
+    {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+     4},
+    {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6},
+    {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 5},
+};
+
+// Endgames, where king moves make up much of the tree.
+const struct {
+  const char* const fen;
+  int depth;
+} kEndgamePositions[] = {
+    {"8/8/8/8/8/8/6k1/4K2R w K - 0 1", 6},
+    {"8/8/1k6/8/2pP4/8/8/3K4 b - d3 0 1", 7},
+    {"8/P1k5/K7/8/8/8/8/8 w - - 0 1", 7},
+    {"K7/8/2n5/1n6/8/8/8/k6N w - - 0 1", 6},
+    {"8/8/3k4/3p4/8/3P4/3K4/8 w - - 0 1", 8},
+    {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5},
+};
+
+uint64_t PerftCopyMake(const ChessBoard& board, int depth) {
+  if (depth == 0) return 1;
+  uint64_t nodes = 0;
+  for (auto move : board.GenerateLegalMoves()) {
+    auto new_board = board;
+    new_board.ApplyMove(move);
+    new_board.Mirror();
+    nodes += PerftCopyMake(new_board, depth - 1);
+  }
+  return nodes;
+}
+
+template <Color kUs>
+uint64_t PerftColorBoard(const ColorBoard& board, int depth) {
+  constexpr Color kThem = kUs == WHITE ? BLACK : WHITE;
+  if (depth == 0) return 1;
+  uint64_t nodes = 0;
+  for (auto move : board.GenerateLegalMoves<kUs>()) {
+    auto new_board = board;
+    new_board.ApplyMove<kUs>(move);
+    nodes += PerftColorBoard<kThem>(new_board, depth - 1);
+  }
+  return nodes;
+}
+
+uint64_t PerftMakeUnmake(ChessBoard* board, int depth) {
+  if (depth == 0) return 1;
+  uint64_t nodes = 0;
+  for (auto move : board->GenerateLegalMoves()) {
+    ChessBoard::UndoInfo undo;
+    board->DoMove(move, &undo);
+    board->Mirror();
+    nodes += PerftMakeUnmake(board, depth - 1);
+    board->Mirror();
+    board->UndoMove(move, undo);
+  }
+  return nodes;
+}
+
+// Counts the checking moves among the legal moves at the leaves of the tree,
+// with @gives_check deciding whether a move checks.
+template <typename GivesCheck>
+uint64_t CountChecks(const ChessBoard& board, int depth,
+                     GivesCheck gives_check, uint64_t* moves) {
+  const MoveList legal_moves = board.GenerateLegalMoves();
+  uint64_t checks = 0;
+  if (depth <= 1) {
+    *moves += legal_moves.size();
+    const CheckInfo check_info = board.GenerateCheckInfo();
+    for (auto move : legal_moves) {
+      checks += gives_check(board, move, check_info);
+    }
+    return checks;
+  }
+  for (auto move : legal_moves) {
+    auto new_board = board;
+    new_board.ApplyMove(move);
+    new_board.Mirror();
+    checks += CountChecks(new_board, depth - 1, gives_check, moves);
+  }
+  return checks;
+}
+
+// Perft which also tests for check and counts the mobility at each node, as
+// an evaluation would. Returns the nodes and adds the mobility to @mobility.
+uint64_t PerftSearchNode(const ChessBoard& board, int depth,
+                         uint64_t* mobility) {
+  const MoveList moves = board.GenerateLegalMoves();
+  *mobility += board.IsUnderCheck() + board.GetMobility().king;
+  if (depth == 0) return 1;
+  uint64_t nodes = 0;
+  for (auto move : moves) {
+    auto new_board = board;
+    new_board.ApplyMove(move);
+    new_board.Mirror();
+    nodes += PerftSearchNode(new_board, depth - 1, mobility);
+  }
+  return nodes;
+}
+
+void RunEndgames(const char* name, int depth_adjustment) {
+  uint64_t total_nodes = 0;
+  uint64_t mobility = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto& position : kEndgamePositions) {
+    const ChessBoard board(position.fen);
+    total_nodes +=
+        PerftSearchNode(board, position.depth + depth_adjustment, &mobility);
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::printf("%-12s %12llu nodes %8.3f s %8.2f Mnps (%llu)\n", name,
+              static_cast<unsigned long long>(total_nodes), elapsed.count(),
+              total_nodes / elapsed.count() / 1e6,
+              static_cast<unsigned long long>(mobility));
+}
+
+template <typename GivesCheck>
+void RunChecks(const char* name, int depth_adjustment,
+               GivesCheck gives_check) {
+  uint64_t total_checks = 0;
+  uint64_t total_moves = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto& position : kPositions) {
+    const ChessBoard board(position.fen);
+    total_checks += CountChecks(board, position.depth + depth_adjustment - 1,
+                                gives_check, &total_moves);
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::printf("%-12s %12llu checks %8.3f s %8.2f M moves/s\n", name,
+              static_cast<unsigned long long>(total_checks), elapsed.count(),
+              total_moves / elapsed.count() / 1e6);
+}
+
+template <typename Perft>
+void Run(const char* name, int depth_adjustment, Perft perft) {
+  uint64_t total_nodes = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto& position : kPositions) {
+    ChessBoard board(position.fen);
+    total_nodes += perft(&board, position.depth + depth_adjustment);
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::printf("%-12s %12llu nodes %8.3f s %8.2f Mnps\n", name,
+              static_cast<unsigned long long>(total_nodes), elapsed.count(),
+              total_nodes / elapsed.count() / 1e6);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const int depth_adjustment = argc > 1 ? std::atoi(argv[1]) : 0;
+  std::printf("%s\n", BackendsDebugString().c_str());
+  std::printf("Check detection:\n");
+  RunChecks("copy-apply", depth_adjustment,
+            [](const ChessBoard& board, Move move, const CheckInfo&) {
+              auto new_board = board;
+              new_board.ApplyMove(move);
+              new_board.Mirror();
+              return new_board.IsUnderCheck();
+            });
+  RunChecks("GivesCheck", depth_adjustment,
+            [](const ChessBoard& board, Move move,
+               const CheckInfo& check_info) {
+              return board.GivesCheck(move, check_info);
+            });
+  for (auto backend : {SliderBackend::kPext, SliderBackend::kMagic,
+                       SliderBackend::kPortable}) {
+    if (!IsSliderBackendSupported(backend)) continue;
+    SetSliderBackend(backend);
+    std::printf("Slider attacks: %s\n", SliderBackendName(backend));
+    Run("copy-make", depth_adjustment, [](ChessBoard* board, int depth) {
+      return PerftCopyMake(*board, depth);
+    });
+    Run("make/unmake", depth_adjustment, [](ChessBoard* board, int depth) {
+      return PerftMakeUnmake(board, depth);
+    });
+    Run("color", depth_adjustment, [](ChessBoard* board, int depth) {
+      const ColorBoard color_board(*board);
+      return color_board.side_to_move() == WHITE
+                 ? PerftColorBoard<WHITE>(color_board, depth)
+                 : PerftColorBoard<BLACK>(color_board, depth);
+    });
+    RunEndgames("endgames", depth_adjustment);
+  }
+  return 0;
+}
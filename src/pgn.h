@@ -42,7 +42,7 @@ namespace lczero {
 
 struct Opening {
   std::string start_fen = ChessBoard::kStartposFen;
-  MoveList moves;
+  std::vector<Move> moves;
 };
 
 inline bool GzGetLine(gzFile file, std::string& line) {
@@ -315,7 +315,7 @@ class PgnReader {
   }
 
   ChessBoard cur_board_{ChessBoard::kStartposFen};
-  MoveList cur_game_;
+  std::vector<Move> cur_game_;
   std::string cur_startpos_ = ChessBoard::kStartposFen;
   std::vector<Opening> games_;
 };
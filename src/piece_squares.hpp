@@ -59,24 +59,21 @@ constexpr BitBoard piece_square_king_end_game_bits[] = {
 
 inline int32_t score_position_with_piece_squares(const Position& position)
 {
-  auto our_board = position.GetBoard();
-  auto their_board = position.GetThemBoard();
-
-
-
+  const auto& our_board = position.GetBoard();
+  // Their pieces, mirrored so the tables see them from their own side.
+  auto their_side = [](BitBoard pieces) { pieces.Mirror(); return pieces; };
   auto our_pawns = our_board.pawns()&our_board.ours();
-  auto their_pawns = their_board.pawns()&their_board.ours();
+  auto their_pawns = their_side(our_board.pawns()&our_board.theirs());
   auto our_knights = our_board.knights()&our_board.ours();
-  auto their_knights = their_board.knights()&their_board.ours();
+  auto their_knights = their_side(our_board.knights()&our_board.theirs());
   auto our_bishops = our_board.bishops()&our_board.ours();
-  auto their_bishops = their_board.bishops()&their_board.ours();
+  auto their_bishops = their_side(our_board.bishops()&our_board.theirs());
   auto our_rooks = our_board.rooks()&our_board.ours();
-  auto their_rooks = their_board.rooks()&their_board.ours();
+  auto their_rooks = their_side(our_board.rooks()&our_board.theirs());
   auto our_queens = our_board.queens()&our_board.ours();
-  auto their_queens = their_board.queens()&their_board.ours();
+  auto their_queens = their_side(our_board.queens()&our_board.theirs());
   auto our_kings = our_board.kings()&our_board.ours();
-  auto their_kings = their_board.kings()&their_board.ours();
-
+  auto their_kings = their_side(our_board.kings()&our_board.theirs());
   BitBoard our_0_bits;
   BitBoard our_1_bits;
   BitBoard our_2_bits;
@@ -170,9 +167,6 @@ inline int32_t score_position_with_piece_squares(const Position& position)
   int32_t total = bits_4*(1<<4) + bits_3*(1<<3) + bits_2*(1<<2) + bits_1*(1<<1) + bits_0;
   // Account for 5x scaler
   total = total*5;
-  // Account for -50 per piece offset
-  int32_t num_pieces = (our_board.ours().count()) - (their_board.theirs().count());
-  total += num_pieces*-50;
   return total;
 }
 #endif //CHESS_WEEKEND_PIECE_SQUARES_HPP
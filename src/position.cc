@@ -63,9 +63,8 @@ namespace lczero {
 
 Position::Position(const Position& parent, Move m)
     : rule50_ply_(parent.rule50_ply_ + 1), ply_count_(parent.ply_count_ + 1) {
-  them_board_ = parent.us_board_;
-  const bool is_zeroing = them_board_.ApplyMove(m);
-  us_board_ = them_board_;
+  us_board_ = parent.us_board_;
+  const bool is_zeroing = us_board_.ApplyMove(m);
   us_board_.Mirror();
   if (is_zeroing) rule50_ply_ = 0;
 }
@@ -73,8 +72,6 @@ Position::Position(const Position& parent, Move m)
 Position::Position(const ChessBoard& board, int rule50_ply, int game_ply)
     : rule50_ply_(rule50_ply), repetitions_(0), ply_count_(game_ply) {
   us_board_ = board;
-  them_board_ = board;
-  them_board_.Mirror();
 }
 
 uint64_t Position::Hash() const {
@@ -162,7 +159,7 @@ uint64_t PositionHistory::HashLast(int positions) const {
 
 std::string GetFen(const Position& pos) {
   std::string result;
-  const ChessBoard& board = pos.GetWhiteBoard();
+  const ChessBoard board = pos.GetWhiteBoard();
   for (int row = 7; row >= 0; --row) {
     int emptycounter = 0;
     for (int col = 0; col < 8; ++col) {
@@ -64,20 +64,23 @@ class Position {
 
   // Gets board from the point of view of player to move.
   const ChessBoard& GetBoard() const { return us_board_; }
-  // Gets board from the point of view of opponent.
-  const ChessBoard& GetThemBoard() const { return them_board_; }
+  // Gets board from the point of view of opponent, mirrored on each call.
+  ChessBoard GetThemBoard() const {
+    ChessBoard board = us_board_;
+    board.Mirror();
+    return board;
+  }
   // Gets board from the point of view of the white player.
-  const ChessBoard& GetWhiteBoard() const {
-    return us_board_.flipped() ? them_board_ : us_board_;
+  ChessBoard GetWhiteBoard() const {
+    return us_board_.flipped() ? GetThemBoard() : us_board_;
   };
 
   std::string DebugString() const;
 
  private:
-  // The board from the point of view of the player to move.
+  // The board from the point of view of the player to move. The opponent's
+  // view is only mirrored from it when asked for.
   ChessBoard us_board_;
-  // The board from the point of view of opponent.
-  ChessBoard them_board_;
 
   // How many half-moves without capture or pawn move was there.
   int rule50_ply_ = 0;
@@ -0,0 +1,151 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018-2019 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#include "transposition_table.h"
+
+#include <algorithm>
+
+namespace lczero {
+
+namespace {
+// The data word of an entry:
+// bits 0..14 move, as from, to and promotion
+// bits 16..47 score
+// bits 48..55 depth
+// bits 56..57 bound
+// bits 58..63 age of the search that wrote it
+// A stored bound is never kNone, so the word of a used entry is never zero.
+uint64_t Pack(Move move, int score, int depth, Bound bound, uint8_t age) {
+  const uint64_t packed_move =
+      move.to().as_int() | (move.from().as_int() << 6) |
+      (static_cast<uint64_t>(move.promotion()) << 12);
+  return packed_move |
+         (static_cast<uint64_t>(static_cast<uint32_t>(score)) << 16) |
+         (static_cast<uint64_t>(static_cast<uint8_t>(depth)) << 48) |
+         (static_cast<uint64_t>(bound) << 56) |
+         (static_cast<uint64_t>(age) << 58);
+}
+
+Move UnpackMove(uint64_t data) {
+  return Move(BoardSquare((data >> 6) & 63), BoardSquare(data & 63),
+              Move::Promotion((data >> 12) & 7));
+}
+int UnpackScore(uint64_t data) {
+  return static_cast<int32_t>(static_cast<uint32_t>(data >> 16));
+}
+int UnpackDepth(uint64_t data) {
+  return static_cast<int8_t>(static_cast<uint8_t>(data >> 48));
+}
+Bound UnpackBound(uint64_t data) { return Bound((data >> 56) & 3); }
+uint8_t UnpackAge(uint64_t data) { return data >> 58; }
+}  // namespace
+
+TranspositionTable::TranspositionTable(size_t size_mb) { Resize(size_mb); }
+
+void TranspositionTable::Resize(size_t size_mb) {
+  size_mb = std::min(size_mb, kMaxSizeMb);
+  num_buckets_ = std::max<size_t>(1, (size_mb << 20) / sizeof(Bucket));
+  // Zero-initialized by the atomics' initializers.
+  buckets_.reset();
+  buckets_.reset(new Bucket[num_buckets_]);
+  size_mb_ = size_mb;
+  age_ = 0;
+}
+
+void TranspositionTable::Clear() {
+  for (size_t i = 0; i < num_buckets_; i++) {
+    for (auto& slot : buckets_[i].slots) {
+      slot.key_xor_data.store(0, std::memory_order_relaxed);
+      slot.data.store(0, std::memory_order_relaxed);
+    }
+  }
+  age_ = 0;
+}
+
+bool TranspositionTable::Probe(uint64_t key, TTEntry* entry) const {
+  const Bucket& bucket = GetBucket(key);
+  for (const auto& slot : bucket.slots) {
+    const uint64_t data = slot.data.load(std::memory_order_relaxed);
+    if ((slot.key_xor_data.load(std::memory_order_relaxed) ^ data) != key ||
+        data == 0) {
+      continue;
+    }
+    entry->move = UnpackMove(data);
+    entry->score = UnpackScore(data);
+    entry->depth = UnpackDepth(data);
+    entry->bound = UnpackBound(data);
+    return true;
+  }
+  return false;
+}
+
+void TranspositionTable::Store(uint64_t key, Move move, int score, int depth,
+                               Bound bound) {
+  Bucket& bucket = GetBucket(key);
+  Slot* replace = nullptr;
+  int replace_value = 0;
+  for (auto& slot : bucket.slots) {
+    const uint64_t data = slot.data.load(std::memory_order_relaxed);
+    if (data != 0 &&
+        (slot.key_xor_data.load(std::memory_order_relaxed) ^ data) == key) {
+      // Keeps a much deeper result of this search over a bound.
+      if (bound != Bound::kExact && UnpackAge(data) == age_ &&
+          depth + 4 <= UnpackDepth(data)) {
+        return;
+      }
+      if (!move) move = UnpackMove(data);
+      replace = &slot;
+      break;
+    }
+    // Empty entries go first, then the ones from earlier searches, then the
+    // shallowest.
+    const int value = data == 0 ? -1000
+                                : UnpackDepth(data) -
+                                      8 * ((age_ - UnpackAge(data)) & kAgeMask);
+    if (!replace || value < replace_value) {
+      replace = &slot;
+      replace_value = value;
+    }
+  }
+  const uint64_t data = Pack(move, score, depth, bound, age_);
+  replace->key_xor_data.store(key ^ data, std::memory_order_relaxed);
+  replace->data.store(data, std::memory_order_relaxed);
+}
+
+int TranspositionTable::Hashfull() const {
+  const size_t sample = std::min<size_t>(num_buckets_, 250);
+  int used = 0;
+  for (size_t i = 0; i < sample; i++) {
+    for (const auto& slot : buckets_[i].slots) {
+      const uint64_t data = slot.data.load(std::memory_order_relaxed);
+      if (data != 0 && UnpackAge(data) == age_) used++;
+    }
+  }
+  return used * 1000 / static_cast<int>(sample * kSlotsPerBucket);
+}
+
+}  // namespace lczero
@@ -0,0 +1,116 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018-2019 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+
+  Additional permission under GNU GPL version 3 section 7
+
+  If you modify this Program, or any covered work, by linking or
+  combining it with NVIDIA Corporation's libraries from the NVIDIA CUDA
+  Toolkit and the NVIDIA CUDA Deep Neural Network library (or a
+  modified version of those libraries), containing parts covered by the
+  terms of the respective license agreement, the licensors of this
+  Program grant you additional permission to convey the resulting work.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "bitboard.h"
+
+namespace lczero {
+
+// How the stored score relates to the true score of the position.
+enum class Bound : uint8_t {
+  kNone,
+  // The true score is at most the stored one (no move reached alpha).
+  kUpper,
+  // The true score is at least the stored one (a move reached beta).
+  kLower,
+  kExact,
+};
+
+// What a probe returns. The move is relative to the board probed, the score is
+// whatever the search stored.
+struct TTEntry {
+  Move move;
+  int score = 0;
+  int depth = 0;
+  Bound bound = Bound::kNone;
+};
+
+// Fixed-size hash table of search results, keyed by ChessBoard::Hash().
+//
+// Entries are two 64-bit words: the packed move, score, depth, bound and age,
+// and the key XORed with those. Threads read and write the words without
+// locks; an entry torn by a concurrent write no longer XORs back to the key and
+// reads as a miss. Entries come in buckets of four filling a cache line, and a
+// key can only be in its bucket, so a probe touches a single line.
+class TranspositionTable {
+ public:
+  explicit TranspositionTable(size_t size_mb = kDefaultSizeMb);
+
+  static constexpr size_t kDefaultSizeMb = 16;
+  static constexpr size_t kMaxSizeMb = 1 << 16;
+
+  // Reallocates the table with @size_mb megabytes (at least one bucket),
+  // dropping all entries. Not safe while searching.
+  void Resize(size_t size_mb);
+  // Drops all entries, e.g. for a new game. Not safe while searching.
+  void Clear();
+  // Starts a new search: entries from earlier ones are replaced first.
+  void NewSearch() { age_ = (age_ + 1) & kAgeMask; }
+
+  // Returns whether @key is in the table, filling @entry if it is.
+  bool Probe(uint64_t key, TTEntry* entry) const;
+  // Stores a result, replacing the entry of the same key if it isn't much
+  // deeper, or else the shallowest and oldest entry of the bucket. An empty
+  // @move keeps the move already stored for the key.
+  void Store(uint64_t key, Move move, int score, int depth, Bound bound);
+
+  // Permille of the entries written by the current search, from a sample.
+  int Hashfull() const;
+  size_t size_mb() const { return size_mb_; }
+
+ private:
+  struct Slot {
+    std::atomic<uint64_t> key_xor_data{0};
+    std::atomic<uint64_t> data{0};
+  };
+  static constexpr int kSlotsPerBucket = 4;
+  struct alignas(64) Bucket {
+    Slot slots[kSlotsPerBucket];
+  };
+  static_assert(sizeof(Bucket) == 64);
+
+  static constexpr uint8_t kAgeMask = 63;
+
+  Bucket& GetBucket(uint64_t key) const {
+    // Maps the key onto the buckets without needing a power of two.
+    return buckets_[static_cast<uint64_t>(
+        (static_cast<unsigned __int128>(key) * num_buckets_) >> 64)];
+  }
+
+  std::unique_ptr<Bucket[]> buckets_;
+  size_t num_buckets_ = 0;
+  size_t size_mb_ = 0;
+  uint8_t age_ = 0;
+};
+
+}  // namespace lczero
@@ -0,0 +1,81 @@
+/*
+  This file is part of Leela Chess Zero.
+  Copyright (C) 2018-2019 The LCZero Authors
+
+  Leela Chess is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Leela Chess is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Leela Chess.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "transposition_table.h"
+
+#include <gtest/gtest.h>
+
+namespace lczero {
+
+TEST(TranspositionTable, StoreAndProbe) {
+  TranspositionTable tt(1);
+  const uint64_t key = 0x0123456789ABCDEFULL;
+  TTEntry entry;
+  EXPECT_FALSE(tt.Probe(key, &entry));
+
+  tt.Store(key, Move("e7e8q"), -49990, 7, Bound::kLower);
+  ASSERT_TRUE(tt.Probe(key, &entry));
+  EXPECT_EQ(entry.move, Move("e7e8q"));
+  EXPECT_EQ(entry.score, -49990);
+  EXPECT_EQ(entry.depth, 7);
+  EXPECT_EQ(entry.bound, Bound::kLower);
+  EXPECT_FALSE(tt.Probe(key ^ 1, &entry));
+
+  // A shallow bound doesn't replace a deep result of the same search, an
+  // exact score does, keeping the move if it has none.
+  tt.Store(key, Move("a2a3"), 10, 2, Bound::kUpper);
+  ASSERT_TRUE(tt.Probe(key, &entry));
+  EXPECT_EQ(entry.depth, 7);
+  tt.Store(key, Move(), 20, 2, Bound::kExact);
+  ASSERT_TRUE(tt.Probe(key, &entry));
+  EXPECT_EQ(entry.move, Move("e7e8q"));
+  EXPECT_EQ(entry.score, 20);
+  EXPECT_EQ(entry.bound, Bound::kExact);
+
+  tt.Clear();
+  EXPECT_FALSE(tt.Probe(key, &entry));
+}
+
+TEST(TranspositionTable, Replacement) {
+  // A single bucket of four entries.
+  TranspositionTable tt(0);
+  for (uint64_t key = 1; key <= 4; key++) {
+    tt.Store(key, Move("e2e4"), 0, 10 - key, Bound::kExact);
+  }
+  // The fifth key replaces the shallowest entry.
+  tt.Store(5, Move("e2e4"), 0, 1, Bound::kExact);
+  TTEntry entry;
+  EXPECT_FALSE(tt.Probe(4, &entry));
+  EXPECT_TRUE(tt.Probe(5, &entry));
+  EXPECT_TRUE(tt.Probe(1, &entry));
+
+  // Entries of earlier searches go first however deep.
+  tt.NewSearch();
+  tt.Store(3, Move("e2e4"), 0, 7, Bound::kExact);
+  tt.Store(6, Move("e2e4"), 0, 1, Bound::kExact);
+  EXPECT_TRUE(tt.Probe(3, &entry));
+  EXPECT_TRUE(tt.Probe(6, &entry));
+  EXPECT_EQ(tt.Hashfull(), 500);
+}
+
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}